@@ -2,6 +2,7 @@ import fitz  # PyMuPDF
 import pytesseract
 from PIL import Image
 import io
+import os
 from statistics import mean
 from typing import List, Tuple
 
@@ -20,7 +21,9 @@ class StoryProcessor:
     """proccess story and extract text, entities and key paragraphs"""
 
     def __init__(self):
-        self.text_ranker = TextRanker()
+        # with TEXTRANKER_SOCKET set, ranking runs in the shared ranking daemon instead of this worker
+        socket_path = os.environ.get("TEXTRANKER_SOCKET")
+        self.text_ranker = textranker.RankingClient(socket_path) if socket_path else TextRanker()
 
     def create_story_from_file(self, path: str) -> Story:
         """create a Story object from a file path"""
@@ -40,6 +43,8 @@ class StoryProcessor:
     def _extract_text_from_blocks(self, blocks, continuous_text: str, paragraphs: list,
                                   current_paragraph_start: int, prev_block) -> Tuple:
         """text extraction from blocks"""
+        # paragraphs are cut where the layout moves to a new block, the text has no separators to split on -
+        # textranker.ParagraphSegmenter is for plain text sources (ExtractKeyParagraphsSegmented)
         blocks = sorted(blocks, key=lambda b: (b[1], b[0]))
         text_elements = []
 
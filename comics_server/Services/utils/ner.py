@@ -4,7 +4,7 @@ from typing import List
 
 from FastAPIProject.config.config_loader import config
 
-from textranker import Interval, IntervalTree
+from textranker import Interval, LabelIntervalTree
 from collections import Counter
 from FastAPIProject.Services.maverick_coref.maverick import Maverick
 from torch import cuda
@@ -36,14 +36,11 @@ def entity_extraction(chapters: list[str]) -> list[Entity]:
         # print(ners)
         corefs = coreference_resolution(chapter)
 
-        # map the loction -> (text, label)
-        ner_positions = {(start, end): (text, label) for text, label, start, end in ners}
-
-        # build the interval tree for NER positions
-        ner_tree = IntervalTree()
+        # build the interval tree for NER positions, the payload is the label id (nlp.vocab.strings)
+        ner_tree = LabelIntervalTree()
         for text, label, start, end in ners:
             interval = Interval(start, end)
-            ner_tree.insert(interval)
+            ner_tree.insert(nlp.vocab.strings.add(label), interval)
 
         # map cluster id -> list of coreference -label
         clusters = {}
@@ -63,13 +60,7 @@ def entity_extraction(chapters: list[str]) -> list[Entity]:
                     continue
 
                 # extract the label from the first overlap
-                overlap_interval = overlap_result['interval']
-                overlap_start = overlap_interval.low
-                overlap_end = overlap_interval.high
-
-                if (overlap_start, overlap_end) in ner_positions:
-                    ner_text, ner_label = ner_positions[(overlap_start, overlap_end)]
-                    labels.append(ner_label)
+                labels.append(nlp.vocab.strings[overlap_result['label']])
 
             print(labels)
             label = Counter(labels).most_common(1)[0][0] if labels else "UNKNOWN"
@@ -1,33 +1,386 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
 
-struct Interval {
-	int low, high;
+// Header-only AVL interval tree. Key is the type of the endpoints (int for str indices, long long for byte
+// offsets of whole books), Payload is what a query returns with the interval, so the caller does not need a
+// side table from positions back to its data. Payload needs operator< (the payload-ordered tree) and operator<<.
+
+template <typename Key>
+struct BasicInterval {
+	Key low, high;
 };
 
-class Node
+typedef BasicInterval<int> Interval;
+typedef BasicInterval<long long> Interval64;
+
+// Payloads besides a paragraph index (size_t)
+struct LabelId {
+	uint64_t value;  // e.g. the hash of a spaCy label, nlp.vocab.strings[value] is the label text
+};
+inline bool operator<(const LabelId& a, const LabelId& b) { return a.value < b.value; }
+inline std::ostream& operator<<(std::ostream& out, const LabelId& label) { return out << label.value; }
+
+struct MentionId {
+	uint32_t entity;  // entity index
+	uint32_t index;   // mention index of the entity
+};
+inline bool operator<(const MentionId& a, const MentionId& b) {
+	return a.entity != b.entity ? a.entity < b.entity : a.index < b.index;
+}
+inline std::ostream& operator<<(std::ostream& out, const MentionId& mention) {
+	return out << mention.entity << ":" << mention.index;
+}
+
+
+template <typename Key, typename Payload>
+class IntervalNode
 {
 public:
+	typedef BasicInterval<Key> IntervalType;
+	typedef std::shared_ptr<IntervalNode> Ptr;
+
 	int Getheight();
-	static std::shared_ptr<Node> rightRotate(std::shared_ptr<Node> y);
-	static std::shared_ptr<Node> leftRotate(std::shared_ptr<Node> x);
+	static Ptr rightRotate(Ptr y);
+	static Ptr leftRotate(Ptr x);
 	int getBalance();
 	void updateHeightAndMax();
-	static std::shared_ptr<Node> insertTree(std::shared_ptr<Node> root, std::shared_ptr<Node> n);
-	static bool isOverlapping(Interval i1, Interval i2);
-	Node* overlapSearch(Interval i);
+	// AVL insertion that does not change root - the nodes on the insertion path are copied and the
+	// rest of the tree is shared with the old version, so readers of the old root are not affected
+	// byPayload orders the tree by (payload, low) instead of low, for counts of a single payload
+	static Ptr insertPersistent(const Ptr& root, Ptr n, bool byPayload = false);
+	static bool isOverlapping(IntervalType i1, IntervalType i2);
+
+	// Order statistics, O(log n) with the subtree sizes
+	static size_t size(const IntervalNode* root) { return root ? root->count : 0; }
+	// Number of intervals whose low is smaller than key
+	static size_t rank(const IntervalNode* root, Key key);
+	// Same, only for intervals with this payload - root of a tree ordered by payload
+	static size_t rank(const IntervalNode* root, const Payload& payload, Key key);
+	// The interval with the k-th smallest low (0-based), nullptr if k >= size
+	static const IntervalNode* select(const IntervalNode* root, size_t k);
+	IntervalNode* overlapSearch(IntervalType i);
 	void inorder();
-	int GetParagraphIndex();
-	Interval GetInterval() const { return i; }
-	Node(size_t paragraphIndex, Interval i);
-	Node(Interval i);
-	~Node();
+	const Payload& GetPayload() const { return payload; }
+	IntervalType GetInterval() const { return i; }
+	IntervalNode(const Payload& payload, IntervalType i);
+	IntervalNode(IntervalType i);
 
 private:
-	size_t paragraphIndex;
-	Interval i;
-	int max;
-	std::shared_ptr<Node> left, right;
+	// true if (aPayload, aLow) comes before (bPayload, bLow) in the order of the tree
+	static bool precedes(const Payload& aPayload, Key aLow, const Payload& bPayload, Key bLow, bool byPayload);
+	static int heightOf(const Ptr& node) { return node ? node->height : 0; }
+
+	Payload payload;
+	IntervalType i;
+	Key max;
+	Ptr left, right;
 	int height;
+	size_t count;  // number of intervals in the subtree
 };
+
+// The paragraph tree of the ranker - str index endpoints, the payload is the paragraph index
+typedef IntervalNode<int, size_t> Node;
+
+
+// A version of a tree. insert copies the nodes on its path (see insertPersistent), so a copy of the tree is
+// O(1) and is not changed by later inserts into the original - that is how IntervalTreeWrapper publishes versions.
+// The intervals are also kept ordered by (payload, low), for counts of a single payload.
+// Counts are over the intervals whose low falls in [low, high).
+template <typename Key, typename Payload>
+class IntervalTree
+{
+public:
+	typedef BasicInterval<Key> IntervalType;
+	typedef IntervalNode<Key, Payload> NodeType;
+
+	void insert(const Payload& payload, const IntervalType& interval);
+	// An interval that overlaps interval (ends included), nullptr if none
+	const NodeType* overlapSearch(const IntervalType& interval) const { return root ? root->overlapSearch(interval) : nullptr; }
+	void inorder() const { if (root) root->inorder(); }
+	bool isEmpty() const { return root == nullptr; }
+	size_t size() const { return NodeType::size(root.get()); }
+
+	size_t rangeCount(Key low, Key high) const;
+	size_t payloadCount(const Payload& payload, Key low, Key high) const;
+	size_t rank(Key key) const { return NodeType::rank(root.get(), key); }
+	const NodeType* select(size_t k) const { return NodeType::select(root.get(), k); }
+	// Counts of [start, start + window), [start + window, start + 2 * window) ... up to end,
+	// of the intervals with *payload, or of all intervals if payload is nullptr
+	std::vector<size_t> histogram(Key start, Key end, Key window, const Payload* payload = nullptr) const;
+
+private:
+	typename NodeType::Ptr root;
+	typename NodeType::Ptr payloadRoot;  // the same intervals ordered by (payload, low)
+};
+
+
+template <typename Key, typename Payload>
+IntervalNode<Key, Payload>::IntervalNode(const Payload& payload, IntervalType i)
+	: payload(payload), i(i), max(i.high), left(nullptr), right(nullptr), height(1), count(1)
+{
+}
+
+template <typename Key, typename Payload>
+IntervalNode<Key, Payload>::IntervalNode(IntervalType i)
+	: payload(), i(i), max(i.high), left(nullptr), right(nullptr), height(1), count(1)
+{
+}
+
+// A utility function to get the height of the tree
+template <typename Key, typename Payload>
+int IntervalNode<Key, Payload>::Getheight() {
+	return this->height;
+}
+
+// A utility function to right rotate subtree rooted with y
+template <typename Key, typename Payload>
+typename IntervalNode<Key, Payload>::Ptr IntervalNode<Key, Payload>::rightRotate(Ptr y) {
+	if (!y || !y->left) return y;
+
+	Ptr x = y->left;
+	Ptr T2 = x->right;
+
+	// Perform rotation
+	x->right = y;
+	y->left = T2;
+
+	// Update heights and max values
+	y->updateHeightAndMax();
+	x->updateHeightAndMax();
+
+	return x;
+}
+
+// A utility function to left rotate subtree rooted with x
+template <typename Key, typename Payload>
+typename IntervalNode<Key, Payload>::Ptr IntervalNode<Key, Payload>::leftRotate(Ptr x) {
+	if (!x || !x->right) return x;
+
+	Ptr y = x->right;
+	Ptr T2 = y->left;
+
+	// Perform rotation
+	y->left = x;
+	x->right = T2;
+
+	// Update heights and max values
+	x->updateHeightAndMax();
+	y->updateHeightAndMax();
+
+	return y;
+}
+
+// Get balance factor of node
+template <typename Key, typename Payload>
+int IntervalNode<Key, Payload>::getBalance() {
+	return heightOf(this->left) - heightOf(this->right);
+}
+
+template <typename Key, typename Payload>
+void IntervalNode<Key, Payload>::updateHeightAndMax() {
+	// Update height
+	this->height = 1 + std::max(heightOf(this->left), heightOf(this->right));
+
+	this->count = 1 + size(this->left.get()) + size(this->right.get());
+
+	// Update max value
+	this->max = this->i.high;
+	if (this->left && this->left->max > this->max) {
+		this->max = this->left->max;
+	}
+	if (this->right && this->right->max > this->max) {
+		this->max = this->right->max;
+	}
+}
+
+template <typename Key, typename Payload>
+bool IntervalNode<Key, Payload>::precedes(const Payload& aPayload, Key aLow, const Payload& bPayload, Key bLow, bool byPayload) {
+	if (byPayload && (aPayload < bPayload || bPayload < aPayload))
+		return aPayload < bPayload;
+	return aLow < bLow;
+}
+
+template <typename Key, typename Payload>
+typename IntervalNode<Key, Payload>::Ptr IntervalNode<Key, Payload>::insertPersistent(const Ptr& root, Ptr n, bool byPayload) {
+	if (root == nullptr)
+		return n;
+
+	// copy the node, the children stay shared until the insertion goes down into one of them
+	auto copy = std::make_shared<IntervalNode>(*root);
+	auto before = [&](const Ptr& other) {
+		return precedes(n->payload, n->i.low, other->payload, other->i.low, byPayload);
+	};
+
+	if (before(copy))
+		copy->left = insertPersistent(copy->left, n, byPayload);
+	else
+		copy->right = insertPersistent(copy->right, n, byPayload);
+
+	copy->updateHeightAndMax();
+	int balance = copy->getBalance();
+
+	// the rotations only change nodes on the insertion path, which are all copies by now
+	// Left Left Case
+	if (balance > 1 && copy->left && before(copy->left))
+		return rightRotate(copy);
+
+	// Right Right Case
+	if (balance < -1 && copy->right && !before(copy->right))
+		return leftRotate(copy);
+
+	// Left Right Case
+	if (balance > 1 && copy->left && !before(copy->left)) {
+		copy->left = leftRotate(copy->left);
+		return rightRotate(copy);
+	}
+
+	// Right Left Case
+	if (balance < -1 && copy->right && before(copy->right)) {
+		copy->right = rightRotate(copy->right);
+		return leftRotate(copy);
+	}
+
+	return copy;
+}
+
+template <typename Key, typename Payload>
+size_t IntervalNode<Key, Payload>::rank(const IntervalNode* root, Key key) {
+	size_t result = 0;
+	while (root != nullptr) {
+		if (root->i.low < key) {
+			result += size(root->left.get()) + 1;
+			root = root->right.get();
+		}
+		else {
+			root = root->left.get();
+		}
+	}
+	return result;
+}
+
+template <typename Key, typename Payload>
+size_t IntervalNode<Key, Payload>::rank(const IntervalNode* root, const Payload& payload, Key key) {
+	// rank of (payload, key) minus the number of intervals with a smaller payload
+	size_t below = 0, result = 0;
+	for (const IntervalNode* node = root; node != nullptr; ) {
+		if (precedes(node->payload, node->i.low, payload, key, true)) {
+			result += size(node->left.get()) + 1;
+			node = node->right.get();
+		}
+		else {
+			node = node->left.get();
+		}
+	}
+	for (const IntervalNode* node = root; node != nullptr; ) {
+		if (node->payload < payload) {
+			below += size(node->left.get()) + 1;
+			node = node->right.get();
+		}
+		else {
+			node = node->left.get();
+		}
+	}
+	return result - below;
+}
+
+template <typename Key, typename Payload>
+const IntervalNode<Key, Payload>* IntervalNode<Key, Payload>::select(const IntervalNode* root, size_t k) {
+	while (root != nullptr) {
+		size_t leftSize = size(root->left.get());
+		if (k < leftSize) {
+			root = root->left.get();
+		}
+		else if (k == leftSize) {
+			return root;
+		}
+		else {
+			k -= leftSize + 1;
+			root = root->right.get();
+		}
+	}
+	return nullptr;
+}
+
+template <typename Key, typename Payload>
+bool IntervalNode<Key, Payload>::isOverlapping(IntervalType i1, IntervalType i2) {
+	return i1.low <= i2.high && i2.low <= i1.high;
+}
+
+template <typename Key, typename Payload>
+IntervalNode<Key, Payload>* IntervalNode<Key, Payload>::overlapSearch(IntervalType i) {
+	// Check if current interval overlaps with query interval
+	if (isOverlapping(this->i, i))
+		return this;
+
+	// If left child exists and its max is >= query's low, search left
+	if (this->left != nullptr && this->left->max >= i.low)
+		return this->left->overlapSearch(i);
+
+	// Otherwise search right
+	if (this->right != nullptr)
+		return this->right->overlapSearch(i);
+
+	return nullptr;
+}
+
+template <typename Key, typename Payload>
+void IntervalNode<Key, Payload>::inorder() {
+	if (this->left) this->left->inorder();
+	std::cout << "[" << this->i.low << ", " << this->i.high << "]"
+		<< " max = " << this->max
+		<< " payload = " << this->payload << std::endl;
+	if (this->right) this->right->inorder();
+}
+
+
+template <typename Key, typename Payload>
+void IntervalTree<Key, Payload>::insert(const Payload& payload, const IntervalType& interval) {
+	// the payload tree needs its own nodes, the children are different
+	root = NodeType::insertPersistent(root, std::make_shared<NodeType>(payload, interval));
+	payloadRoot = NodeType::insertPersistent(payloadRoot, std::make_shared<NodeType>(payload, interval), true);
+}
+
+template <typename Key, typename Payload>
+size_t IntervalTree<Key, Payload>::rangeCount(Key low, Key high) const {
+	if (high <= low) {
+		return 0;
+	}
+	return NodeType::rank(root.get(), high) - NodeType::rank(root.get(), low);
+}
+
+template <typename Key, typename Payload>
+size_t IntervalTree<Key, Payload>::payloadCount(const Payload& payload, Key low, Key high) const {
+	if (high <= low) {
+		return 0;
+	}
+	return NodeType::rank(payloadRoot.get(), payload, high) - NodeType::rank(payloadRoot.get(), payload, low);
+}
+
+template <typename Key, typename Payload>
+std::vector<size_t> IntervalTree<Key, Payload>::histogram(Key start, Key end, Key window, const Payload* payload) const {
+	std::vector<size_t> counts;
+	if (end <= start || window <= 0) {
+		return counts;
+	}
+	counts.reserve((size_t)((end - start - 1) / window + 1));
+
+	// every window is the difference of the ranks of its bounds, each bound is ranked once
+	auto rankOf = [&](Key key) {
+		return payload == nullptr ? NodeType::rank(root.get(), key) : NodeType::rank(payloadRoot.get(), *payload, key);
+	};
+	size_t previous = rankOf(start);
+	for (Key low = start; low < end; ) {
+		Key high = end - low > window ? low + window : end;  // no overflow near the largest key
+		size_t next = rankOf(high);
+		counts.push_back(next - previous);
+		previous = next;
+		low = high;
+	}
+	return counts;
+}
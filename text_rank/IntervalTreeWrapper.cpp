@@ -1,40 +1,68 @@
 #include "IntervalTreeWrapper.h"
+#include <stdexcept>
 
 
+template <typename Key, typename Payload>
+py::object BasicIntervalTreeSnapshot<Key, Payload>::toResult(const IntervalNode<Key, Payload>* result) {
+    if (result == nullptr) {
+        return py::none();
+    }
 
-
-void IntervalTreeWrapper::insert(const Interval& interval) {
-    auto node = std::make_shared<Node>(interval);
-    root = Node::insertTree(root, node);
+    py::dict result_dict;
+    result_dict["interval"] = result->GetInterval();
+    PayloadTraits<Payload>::Put(result_dict, result->GetPayload());
+    return result_dict;
 }
 
-void IntervalTreeWrapper::insert(size_t paragraphIndex, const Interval& interval) {
-    auto node = std::make_shared<Node>(paragraphIndex, interval);
-    root = Node::insertTree(root, node);
+template <typename Key, typename Payload>
+size_t BasicIntervalTreeSnapshot<Key, Payload>::payloadCount(PayloadArg payload, Key low, Key high) const {
+    return tree.payloadCount(PayloadTraits<Payload>::FromArg(payload), low, high);
 }
 
-py::object IntervalTreeWrapper::overlapSearch(const Interval& interval) {
-    if (!root) {
-        return py::none();
+template <typename Key, typename Payload>
+std::vector<size_t> BasicIntervalTreeSnapshot<Key, Payload>::histogram(Key start, Key end, Key window) const {
+    if (window <= 0) {
+        throw std::invalid_argument("window must be positive");
     }
+    return tree.histogram(start, end, window);
+}
 
-    Node* result = root->overlapSearch(interval);
-    if (result == nullptr) {
-        return py::none();
+template <typename Key, typename Payload>
+std::vector<size_t> BasicIntervalTreeSnapshot<Key, Payload>::histogram(Key start, Key end, Key window, PayloadArg payload) const {
+    if (window <= 0) {
+        throw std::invalid_argument("window must be positive");
     }
+    Payload value = PayloadTraits<Payload>::FromArg(payload);
+    return tree.histogram(start, end, window, &value);
+}
 
-    py::dict result_dict;
-    result_dict["interval"] = result->GetInterval();
-    result_dict["paragraph_index"] = result->GetParagraphIndex();
-    return result_dict;
+
+template <typename Key, typename Payload>
+void BasicIntervalTreeWrapper<Key, Payload>::publish(const Payload& payload, const IntervalType& interval) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    // a copy of a tree shares all its nodes, insert only copies the insertion path
+    auto next = std::make_shared<Snapshot>(*load());
+    next->tree.insert(payload, interval);
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(std::move(next)));
 }
 
-void IntervalTreeWrapper::inorder() {
-    if (root) {
-        root->inorder();
-    }
+template <typename Key, typename Payload>
+void BasicIntervalTreeWrapper<Key, Payload>::insert(const IntervalType& interval) {
+    publish(Payload(), interval);
 }
 
-bool IntervalTreeWrapper::isEmpty() const {
-    return this->root == nullptr;
+template <typename Key, typename Payload>
+void BasicIntervalTreeWrapper<Key, Payload>::insert(PayloadArg payload, const IntervalType& interval) {
+    publish(PayloadTraits<Payload>::FromArg(payload), interval);
 }
+
+
+// The trees that are bound to python
+template class BasicIntervalTreeSnapshot<int, size_t>;
+template class BasicIntervalTreeWrapper<int, size_t>;
+template class BasicIntervalTreeSnapshot<long long, size_t>;
+template class BasicIntervalTreeWrapper<long long, size_t>;
+template class BasicIntervalTreeSnapshot<int, LabelId>;
+template class BasicIntervalTreeWrapper<int, LabelId>;
+template class BasicIntervalTreeSnapshot<int, MentionId>;
+template class BasicIntervalTreeWrapper<int, MentionId>;
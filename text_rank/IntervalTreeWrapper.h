@@ -1,5 +1,7 @@
 #pragma once
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "IntervalTree.h"
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
@@ -7,16 +9,112 @@
 namespace py = pybind11;
 
 
-class IntervalTreeWrapper {
+// How a payload crosses to python - Arg is what insert and payloadCount take, Put adds it to a query result.
+// Only the payloads that have traits are bound (see the instantiations at the end of IntervalTreeWrapper.cpp).
+template <typename Payload>
+struct PayloadTraits;
+
+template <>
+struct PayloadTraits<size_t> {
+    typedef size_t Arg;
+    static size_t FromArg(size_t arg) { return arg; }
+    static void Put(py::dict& result, size_t payload) { result["paragraph_index"] = payload; }
+};
+
+template <>
+struct PayloadTraits<LabelId> {
+    typedef uint64_t Arg;
+    static LabelId FromArg(uint64_t arg) { return LabelId{ arg }; }
+    static void Put(py::dict& result, const LabelId& payload) { result["label"] = payload.value; }
+};
+
+template <>
+struct PayloadTraits<MentionId> {
+    typedef std::pair<uint32_t, uint32_t> Arg;  // (entity, mention)
+    static MentionId FromArg(const Arg& arg) { return MentionId{ arg.first, arg.second }; }
+    static void Put(py::dict& result, const MentionId& payload) {
+        result["entity"] = payload.entity;
+        result["mention"] = payload.index;
+    }
+};
+
+
+template <typename Key, typename Payload>
+class BasicIntervalTreeWrapper;
+
+// A read-only version of the tree. Published nodes are never changed, so a snapshot can be
+// queried from any thread while new intervals are inserted, and it keeps its nodes alive.
+// Counts are over the intervals whose low falls in [low, high).
+template <typename Key, typename Payload>
+class BasicIntervalTreeSnapshot {
+public:
+    typedef BasicInterval<Key> IntervalType;
+    typedef typename PayloadTraits<Payload>::Arg PayloadArg;
+
+    explicit BasicIntervalTreeSnapshot(const IntervalTree<Key, Payload>& tree = IntervalTree<Key, Payload>()) : tree(tree) {}
+    py::object overlapSearch(const IntervalType& interval) const { return toResult(tree.overlapSearch(interval)); }
+    void inorder() const { tree.inorder(); }
+    bool isEmpty() const { return tree.isEmpty(); }
+    size_t size() const { return tree.size(); }
+
+    size_t rangeCount(Key low, Key high) const { return tree.rangeCount(low, high); }
+    size_t payloadCount(PayloadArg payload, Key low, Key high) const;
+    size_t rank(Key key) const { return tree.rank(key); }
+    py::object select(size_t k) const { return toResult(tree.select(k)); }
+    // Counts of [start, start + window), [start + window, start + 2 * window) ... up to end,
+    // of all intervals or of the intervals with payload
+    std::vector<size_t> histogram(Key start, Key end, Key window) const;
+    std::vector<size_t> histogram(Key start, Key end, Key window, PayloadArg payload) const;
+
+private:
+    friend class BasicIntervalTreeWrapper<Key, Payload>;
+    static py::object toResult(const IntervalNode<Key, Payload>* result);
+
+    IntervalTree<Key, Payload> tree;
+};
+
+
+// Every insert builds a new version by path copying and publishes it atomically.
+// Writers are serialized with a mutex, readers only load the current version and never wait for an insert.
+// Old versions are freed when the last snapshot that uses them is gone.
+template <typename Key, typename Payload>
+class BasicIntervalTreeWrapper {
 public:
-    IntervalTreeWrapper() : root(nullptr) {}
-    void insert(const Interval& interval);
-    void insert(size_t paragraphIndex, const Interval& interval);
-    py::object overlapSearch(const Interval& interval);
-    void inorder();
-    bool isEmpty() const;
+    typedef BasicInterval<Key> IntervalType;
+    typedef BasicIntervalTreeSnapshot<Key, Payload> Snapshot;
+    typedef typename Snapshot::PayloadArg PayloadArg;
+
+    BasicIntervalTreeWrapper() : current(std::make_shared<Snapshot>()) {}
+    void insert(const IntervalType& interval);
+    void insert(PayloadArg payload, const IntervalType& interval);
+    py::object overlapSearch(const IntervalType& interval) const { return load()->overlapSearch(interval); }
+    void inorder() const { load()->inorder(); }
+    bool isEmpty() const { return load()->isEmpty(); }
+    size_t size() const { return load()->size(); }
+    size_t rangeCount(Key low, Key high) const { return load()->rangeCount(low, high); }
+    size_t payloadCount(PayloadArg payload, Key low, Key high) const { return load()->payloadCount(payload, low, high); }
+    size_t rank(Key key) const { return load()->rank(key); }
+    py::object select(size_t k) const { return load()->select(k); }
+    std::vector<size_t> histogram(Key start, Key end, Key window) const { return load()->histogram(start, end, window); }
+    std::vector<size_t> histogram(Key start, Key end, Key window, PayloadArg payload) const {
+        return load()->histogram(start, end, window, payload);
+    }
+    Snapshot snapshot() const { return *load(); }
 
 private:
-    std::shared_ptr<Node> root;
+    void publish(const Payload& payload, const IntervalType& interval);
+    std::shared_ptr<const Snapshot> load() const { return std::atomic_load(&current); }
+
+    std::shared_ptr<const Snapshot> current;  // only accessed with std::atomic_load / std::atomic_store
+    std::mutex writeMutex;
 };
 
+// The trees that are bound to python
+typedef BasicIntervalTreeSnapshot<int, size_t> IntervalTreeSnapshot;
+typedef BasicIntervalTreeWrapper<int, size_t> IntervalTreeWrapper;  // "IntervalTree", str indices and paragraph indices
+typedef BasicIntervalTreeSnapshot<long long, size_t> IntervalTreeSnapshot64;
+typedef BasicIntervalTreeWrapper<long long, size_t> IntervalTreeWrapper64;  // "IntervalTree64", byte offsets of long books
+typedef BasicIntervalTreeSnapshot<int, LabelId> LabelIntervalTreeSnapshot;
+typedef BasicIntervalTreeWrapper<int, LabelId> LabelIntervalTreeWrapper;  // "LabelIntervalTree", NER spans and their labels
+typedef BasicIntervalTreeSnapshot<int, MentionId> MentionIntervalTreeSnapshot;
+typedef BasicIntervalTreeWrapper<int, MentionId> MentionIntervalTreeWrapper;  // "MentionIntervalTree", entity mentions
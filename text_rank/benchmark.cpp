@@ -0,0 +1,78 @@
+// Compares TextRanker (double) and CompactTextRanker (float) on random chapters:
+// checks that both select the same top-K paragraphs and reports graph memory and time.
+// Not part of the python module or the VS project, build it by hand:
+//   g++ -std=c++14 -O2 -pthread -o benchmark benchmark.cpp text_ranker.cpp similarity.cpp monte_carlo.cpp utf8_index.cpp segmenter.cpp ranking_workspace.cpp local_push.cpp mention_normalizer.cpp
+#include "text_ranker.h"
+#include "random_chapter.h"
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+template <typename Ranker>
+static std::map<int, std::set<EntityIndex>> Rank(Ranker& ranker, const Chapter& chapter, int topK, double& seconds)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto outputs = ranker.ExtractKeyParagraphs(chapter.text, chapter.paragraphs, chapter.entities, topK);
+	seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return outputs;
+}
+
+int main()
+{
+	std::mt19937 rng(2024);
+	const int sizes[] = { 200, 1000, 3000 };
+	const int runs[] = { 20, 5, 3 };
+	const double topKRatios[] = { 0.05, 0.10, 0.65 };
+
+	for (int s = 0; s < 3; s++) {
+		int n = sizes[s];
+		int matched = 0, nearTies = 0, total = 0;
+		double maxRelDiff = 0.0, doubleSeconds = 0.0, floatSeconds = 0.0;
+
+		for (int r = 0; r < runs[s]; r++) {
+			Chapter chapter = RandomChapter(n, 80, rng);
+			for (double ratio : topKRatios) {
+				int topK = (int)(n * ratio);
+				TextRanker ranker;
+				CompactTextRanker compactRanker;
+				ranker.SetMaxParagraphs(0);
+				compactRanker.SetMaxParagraphs(0);
+
+				auto outputs = Rank(ranker, chapter, topK, doubleSeconds);
+				auto compactOutputs = Rank(compactRanker, chapter, topK, floatSeconds);
+				total++;
+				if (outputs == compactOutputs) {
+					matched++;
+				}
+				else {
+					// a swap is only acceptable if the double scores of the swapped paragraphs are a tie at float precision
+					double kth = 1e300, worst = 0.0;
+					for (auto& m : outputs) kth = std::min(kth, (double)ranker.GetScores()[m.first]);
+					for (auto& m : compactOutputs) {
+						if (!outputs.count(m.first))
+							worst = std::max(worst, (kth - ranker.GetScores()[m.first]) / kth);
+					}
+					nearTies += (worst < 1e-6);
+				}
+
+				for (size_t i = 0; i < ranker.GetScores().size(); i++) {
+					double d = ranker.GetScores()[i];
+					double diff = std::fabs(d - compactRanker.GetScores()[i]) / std::max(std::fabs(d), 1e-12);
+					maxRelDiff = std::max(maxRelDiff, diff);
+				}
+			}
+		}
+
+		double n2 = (double)n * n;
+		std::cout << "paragraphs " << n
+			<< " | top-K match " << matched << "/" << total << " (+" << nearTies << " swaps inside float ties)"
+			<< " | max rel diff " << maxRelDiff
+			<< " | graph MB double " << n2 * sizeof(double) / 1e6 << " float " << n2 * sizeof(float) / 1e6
+			<< " | seconds double " << doubleSeconds << " float " << floatSeconds
+			<< std::endl;
+	}
+	return 0;
+}
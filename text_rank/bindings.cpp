@@ -1,9 +1,14 @@
  
 #include "text_ranker.h"
+#include "chapter_detector.h"
+#ifndef _WIN32
+#include "ranking_client.h"
+#endif
 #include "IntervalTree.h"
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "IntervalTreeWrapper.h"
 //#include <pybind11/smart_ptr.h>
 
@@ -11,12 +16,255 @@
 namespace py = pybind11;
 
 
+// TextRanker and CompactTextRanker have the same python interface, only the precision of the graph differs
+template <typename Ranker>
+static void BindRanker(py::module_& m, const char* name, const char* doc) {
+    py::class_<Ranker>(m, name, doc)
+        .def(py::init<>())
+        .def("ExtractKeyParagraphs", &Ranker::ExtractKeyParagraphs,
+            "A function that takes a chapter and entities and returns the K most important paragraphs in the chapter. "
+            "similarity is one of 'log_overlap', 'jaccard', 'cosine', 'idf_overlap'",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"), py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsApprox", &Ranker::ExtractKeyParagraphsApprox,
+            "Like ExtractKeyParagraphs, but the scores are estimated with random walks with restart - for whole books",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"),
+            py::arg("options") = MonteCarloOptions(), py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsUtf8", &Ranker::ExtractKeyParagraphsUtf8,
+            "ExtractKeyParagraphs where paragraphUnits / entityUnits say if the spans are 'codepoints' (str indices) or 'bytes' (UTF-8 offsets)",
+            py::arg("input"), py::arg("paragraphs"), py::arg("paragraphUnits"), py::arg("entities"), py::arg("entityUnits"),
+            py::arg("topK"), py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsBudget", &Ranker::ExtractKeyParagraphsBudget,
+            "Key paragraphs whose total length fits options.budget, redundant ones (similar entities) are skipped",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("options") = BudgetOptions(),
+            py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsAnytime", &Ranker::ExtractKeyParagraphsAnytime,
+            "ExtractKeyParagraphs that stops at options.deadlineMs / options.maxWork and returns the best result so far",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"),
+            py::arg("options") = AnytimeOptions(), py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>())
+        .def("ExtractKeyParagraphsWithGraph", &Ranker::ExtractKeyParagraphsWithGraph,
+            "ExtractKeyParagraphs that also returns the graph (CSR), the out-weights and the scores as numpy arrays",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"), py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>())
+        .def("ExtractKeyParagraphsAndEntities", &Ranker::ExtractKeyParagraphsAndEntities,
+            "ExtractKeyParagraphs that also ranks the entities by their co-occurrence in the paragraphs - "
+            "returns ({paragraph index: entities}, [(entity id, score)] most central first, topEntities 0 - all)",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"), py::arg("topEntities") = 0,
+            py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsFor", &Ranker::ExtractKeyParagraphsFor,
+            "Key paragraphs personalized to the seed entities (paragraphs near their mentions), computed with local push",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("seeds"), py::arg("topK"),
+            py::arg("epsilon") = 1e-5, py::arg("similarity") = "log_overlap")
+        .def("ExtractKeyParagraphsPerEntity", &Ranker::ExtractKeyParagraphsPerEntity,
+            "ExtractKeyParagraphsFor every character (every entity if empty) on one graph - {entity: {paragraph index: entities}}",
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("characters"), py::arg("topK"),
+            py::arg("epsilon") = 1e-5, py::arg("threads") = 0, py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>())
+        .def("ExtractKeyParagraphsSegmented", &Ranker::ExtractKeyParagraphsSegmented,
+            "Splits input into paragraphs natively and ranks them - returns (paragraph spans, {paragraph index: entities})",
+            py::arg("input"), py::arg("segmenter"), py::arg("entities"), py::arg("topK"), py::arg("similarity") = "log_overlap")
+        .def("RankStory", &Ranker::RankStory,
+            "Ranks the chapters of a story, then the paragraphs of every chapter (in parallel) with a global entity-importance prior",
+            py::arg("input"), py::arg("chapters"), py::arg("paragraphs"), py::arg("entities"), py::arg("keyRatio"),
+            py::arg("priorWeight") = 0.3, py::arg("threads") = 0, py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>())
+        .def_property("maxParagraphs", &Ranker::GetMaxParagraphs, &Ranker::SetMaxParagraphs,
+            "Longest chapter (in paragraphs) that is ranked, 0 means no limit")
+        .def_property("mentionPolicy", &Ranker::GetMentionPolicy, &Ranker::SetMentionPolicy,
+            "How the mentions of every entity are normalized before ranking - 'keep', 'dedupe', 'drop_nested' or 'merge'");
+}
+
+// A read-only numpy array on the memory of values - owner is the python object that holds them, the array keeps it alive
+template <typename T>
+static py::array_t<T> ArrayView(const std::vector<T>& values, py::handle owner) {
+    py::array_t<T> array((py::ssize_t)values.size(), values.data(), owner);
+    array.attr("flags").attr("writeable") = false;
+    return array;
+}
+
+// RankingResult and CompactRankingResult, the arrays are views into the result
+template <typename Weight>
+static void BindRankingResult(py::module_& m, const char* name) {
+    typedef BasicRankingResult<Weight> Result;
+    py::class_<Result>(m, name, "Result of ExtractKeyParagraphsWithGraph - the graph is "
+        "scipy.sparse.csr_matrix((weights, targets, offsets)) without copying (targets and offsets have the same dtype)")
+        .def_readonly("keyParagraphs", &Result::keyParagraphs, "{paragraph index: entities} like ExtractKeyParagraphs")
+        .def_property_readonly("paragraphIds", [](py::object self) { return ArrayView(self.cast<const Result&>().paragraphIds, self); },
+            "index in the paragraphs that were passed in, of every node")
+        .def_property_readonly("offsets", [](py::object self) -> py::object {
+                const Result& result = self.cast<const Result&>();
+                return result.IsWide() ? py::object(ArrayView(result.offsets64, self)) : py::object(ArrayView(result.offsets, self));
+            },
+            "the links of node i are targets[offsets[i]:offsets[i + 1]], int32 (int64 from 2^31 links)")
+        .def_property_readonly("targets", [](py::object self) -> py::object {
+                const Result& result = self.cast<const Result&>();
+                return result.IsWide() ? py::object(ArrayView(result.targets64, self)) : py::object(ArrayView(result.targets, self));
+            })
+        .def_property_readonly("weights", [](py::object self) { return ArrayView(self.cast<const Result&>().weights, self); })
+        .def_property_readonly("outWeights", [](py::object self) { return ArrayView(self.cast<const Result&>().outWeights, self); })
+        .def_property_readonly("scores", [](py::object self) { return ArrayView(self.cast<const Result&>().scores, self); });
+}
+
+// Order statistics of IntervalTree and IntervalTreeSnapshot
+template <typename Key, typename Tree>
+static void BindAggregates(py::class_<Tree>& tree) {
+    tree
+        .def("rangeCount", &Tree::rangeCount, "Number of intervals whose low is in [low, high)", py::arg("low"), py::arg("high"))
+        .def("payloadCount", &Tree::payloadCount, "Number of intervals with this payload whose low is in [low, high)",
+            py::arg("payload"), py::arg("low"), py::arg("high"))
+        .def("rank", &Tree::rank, "Number of intervals whose low is smaller than key", py::arg("key"))
+        .def("select", &Tree::select, "The interval with the k-th smallest low as a dict like overlapSearch, or None", py::arg("k"))
+        .def("histogram", py::overload_cast<Key, Key, Key>(&Tree::histogram, py::const_),
+            "Interval counts of the windows [start, start + window), ... up to end",
+            py::arg("start"), py::arg("end"), py::arg("window"))
+        .def("histogram", py::overload_cast<Key, Key, Key, typename Tree::PayloadArg>(&Tree::histogram, py::const_),
+            "Interval counts of the windows [start, start + window), ... up to end, of the intervals with payload",
+            py::arg("start"), py::arg("end"), py::arg("window"), py::arg("payload"));
+}
+
+// An IntervalTree instantiation and its snapshot class, payload says what the queries return with the interval
+template <typename Key, typename Payload>
+static void BindIntervalTree(py::module_& m, const char* name, const char* snapshotName, const char* payload) {
+    typedef BasicIntervalTreeSnapshot<Key, Payload> Snapshot;
+    typedef BasicIntervalTreeWrapper<Key, Payload> Tree;
+    std::string search = std::string("Search for overlapping intervals - returns dict with interval and ") + payload + " or None";
+
+    py::class_<Snapshot> snapshot(m, snapshotName, "A version of an IntervalTree that later inserts do not change");
+    snapshot
+        .def("overlapSearch", &Snapshot::overlapSearch, search.c_str())
+        .def("inorder", &Snapshot::inorder, "Inorder traversal of the tree")
+        .def("isEmpty", &Snapshot::isEmpty, "Check if tree is empty")
+        .def("size", &Snapshot::size, "Number of intervals in this version");
+    BindAggregates<Key>(snapshot);
+
+    py::class_<Tree> tree(m, name);
+    tree
+        .def(py::init<>())
+        .def("insert", py::overload_cast<const typename Tree::IntervalType&>(&Tree::insert),
+            "Insert an interval into the tree")
+        .def("insert", py::overload_cast<typename Tree::PayloadArg, const typename Tree::IntervalType&>(&Tree::insert),
+            (std::string("Insert an interval with ") + payload + " into the tree").c_str())
+        .def("overlapSearch", &Tree::overlapSearch, search.c_str())
+        .def("inorder", &Tree::inorder, "Inorder traversal of the tree")
+        .def("isEmpty", &Tree::isEmpty, "Check if tree is empty")
+        .def("size", &Tree::size, "Number of intervals in the tree")
+        .def("snapshot", &Tree::snapshot,
+            "The current version of the tree - can be queried while other threads keep inserting");
+    BindAggregates<Key>(tree);
+}
+
+
 PYBIND11_MODULE(textranker, m) {
-    py::class_<TextRanker>(m, "TextRanker")
+    // the options classes first - default arguments of the ranker methods are converted when they are defined
+    py::class_<MonteCarloOptions>(m, "MonteCarloOptions", "Options of ExtractKeyParagraphsApprox")
         .def(py::init<>())
-        .def("ExtractKeyParagraphs", &TextRanker::ExtractKeyParagraphs,
-            "A function that takes a chapter and entities and returns the K most important paragraphs in the chapter",
-            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"));
+        .def_readwrite("walksPerRound", &MonteCarloOptions::walksPerRound)
+        .def_readwrite("maxWalks", &MonteCarloOptions::maxWalks)
+        .def_readwrite("tolerance", &MonteCarloOptions::tolerance)
+        .def_readwrite("stableRounds", &MonteCarloOptions::stableRounds)
+        .def_readwrite("stableOverlap", &MonteCarloOptions::stableOverlap)
+        .def_readwrite("threads", &MonteCarloOptions::threads)
+        .def_readwrite("seed", &MonteCarloOptions::seed)
+        .def_readwrite("maxParagraphs", &MonteCarloOptions::maxParagraphs, "0 - the whole input is ranked");
+
+    py::class_<BudgetOptions>(m, "BudgetOptions", "Options of ExtractKeyParagraphsBudget")
+        .def(py::init<>())
+        .def_readwrite("budget", &BudgetOptions::budget)
+        .def_readwrite("charsPerToken", &BudgetOptions::charsPerToken)
+        .def_readwrite("lambda_", &BudgetOptions::lambda)
+        .def_readwrite("costExponent", &BudgetOptions::costExponent);
+
+    py::class_<AnytimeOptions>(m, "AnytimeOptions", "Options of ExtractKeyParagraphsAnytime, 0 - no limit")
+        .def(py::init<>())
+        .def_readwrite("deadlineMs", &AnytimeOptions::deadlineMs)
+        .def_readwrite("maxWork", &AnytimeOptions::maxWork);
+
+    py::class_<AnytimeRanking>(m, "AnytimeRanking", "Result of ExtractKeyParagraphsAnytime")
+        .def_readonly("keyParagraphs", &AnytimeRanking::keyParagraphs, "{paragraph index: entities}")
+        .def_readonly("complete", &AnytimeRanking::complete, "False if the deadline or the work budget stopped the ranking")
+        .def_readonly("graphComplete", &AnytimeRanking::graphComplete, "False if the graph itself was cut short")
+        .def_readonly("converged", &AnytimeRanking::converged, "True if the residual got below the tolerance within maxIter")
+        .def_readonly("iterations", &AnytimeRanking::iterations)
+        .def_readonly("residual", &AnytimeRanking::residual, "largest score change of the last iteration")
+        .def_readonly("work", &AnytimeRanking::work);
+
+    BindRanker<TextRanker>(m, "TextRanker", "Ranks paragraphs, graph and scores in double precision");
+    BindRanker<CompactTextRanker>(m, "CompactTextRanker",
+        "Ranks paragraphs, graph and scores in float (sums in double) - for long chapters where memory traffic dominates");
+
+    BindRankingResult<double>(m, "RankingResult");
+    BindRankingResult<float>(m, "CompactRankingResult");
+
+    m.def("normalizeMentions",
+        [](std::vector<std::vector<std::pair<int, int>>> entities, const std::string& policy, int threads) {
+            MentionPolicy mentionPolicy = MentionPolicyFromName(policy);
+            py::gil_scoped_release release;
+            NormalizeMentions(entities, mentionPolicy, threads);
+            return entities;
+        },
+        "The mentions of every entity sorted, with duplicates, nested spans ('drop_nested') or overlaps ('merge') removed",
+        py::arg("entities"), py::arg("policy") = "drop_nested", py::arg("threads") = 0);
+
+    py::class_<Utf8Index>(m, "Utf8Index", "Code point <-> UTF-8 byte offset translation for one text")
+        .def(py::init<const std::string&>(), py::arg("text"))
+        .def("codePointsNum", &Utf8Index::CodePointsNum)
+        .def("bytesNum", &Utf8Index::BytesNum)
+        .def("isAscii", &Utf8Index::IsAscii)
+        .def("byteOffset", &Utf8Index::ByteOffset, py::arg("codePoint"))
+        .def("codePointOffset", &Utf8Index::CodePointOffset, py::arg("byte"))
+        .def("toBytes", &Utf8Index::ToBytes, "Convert a list of (start, end) code point spans to byte spans", py::arg("spans"))
+        .def("toCodePoints", &Utf8Index::ToCodePoints, "Convert a list of (start, end) byte spans to code point spans", py::arg("spans"));
+
+    py::class_<ParagraphSegmenter>(m, "ParagraphSegmenter",
+        "Native paragraph splitter - separators are literal markers (e.g. '###PARA###') or 'blank_line'")
+        .def(py::init<const std::vector<std::string>&, int>(),
+            py::arg("separators") = std::vector<std::string>(1, ParagraphSegmenter::kBlankLine), py::arg("minParagraphLen") = 40)
+        .def("segment", [](const ParagraphSegmenter& segmenter, const std::string& text, const std::string& units) {
+                return segmenter.Segment(text, SpanUnitsFromName(units));
+            },
+            "(start, end) of every paragraph, units are 'codepoints' (str indices) or 'bytes'",
+            py::arg("text"), py::arg("units") = "codepoints")
+        .def_property_readonly("separators", &ParagraphSegmenter::GetSeparators)
+        .def_property_readonly("minParagraphLen", &ParagraphSegmenter::GetMinParagraphLen);
+
+    py::class_<ChapterDetector>(m, "ChapterDetector",
+        "Streaming extract_chapters_as_indices - pages are added while the PDF is parsed")
+        .def(py::init<double, double>(), py::arg("threshold") = 170.0, py::arg("maxY") = -1.0)
+        .def("addPage", &ChapterDetector::AddPage,
+            "Adds a page (x, y and text length of every element), returns the chapters that are now certain",
+            py::arg("xs"), py::arg("ys"), py::arg("lengths"))
+        .def("finish", &ChapterDetector::Finish, "Ends the document, returns the remaining chapters", py::arg("textLength"))
+        .def_property_readonly("chapters", &ChapterDetector::GetChapters)
+        .def_property_readonly("position", &ChapterDetector::GetPosition);
+
+    py::class_<ChapterPipeline>(m, "ChapterPipeline",
+        "Chapter detection and paragraph segmentation while the PDF is parsed, ranking per chapter")
+        .def(py::init<double, double, const ParagraphSegmenter&>(),
+            py::arg("threshold") = 170.0, py::arg("maxY") = -1.0, py::arg("segmenter") = ParagraphSegmenter())
+        .def("addPage", &ChapterPipeline::AddPage, "Adds a page and the text it added, returns the number of chapters known so far",
+            py::arg("xs"), py::arg("ys"), py::arg("lengths"), py::arg("pageText"))
+        .def("finish", &ChapterPipeline::Finish, "Ends the document and waits for the segmentation",
+            py::arg("textLength"), py::call_guard<py::gil_scoped_release>())
+        .def("getChapters", &ChapterPipeline::GetChapters)
+        .def("getParagraphs", &ChapterPipeline::GetParagraphs, "Paragraph spans of a chapter, waits for them if needed",
+            py::arg("chapter"), py::call_guard<py::gil_scoped_release>())
+        .def("rankChapter", &ChapterPipeline::RankChapter, "Key paragraphs of a chapter - keys are indices in getParagraphs(chapter)",
+            py::arg("chapter"), py::arg("entities"), py::arg("topK"), py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>());
+
+    py::class_<StoryRanking>(m, "StoryRanking", "Result of RankStory")
+        .def_readonly("chapters", &StoryRanking::chapters, "(chapter index, score), most important first")
+        .def_readonly("keyParagraphs", &StoryRanking::keyParagraphs, "per chapter: {paragraph index: entities}")
+        .def_readonly("entityImportance", &StoryRanking::entityImportance, "global importance of every entity (0-1)");
+
+#ifndef _WIN32
+    py::class_<RankingClient>(m, "RankingClient",
+        "Sends ExtractKeyParagraphs to the ranking daemon (ranking_daemon) instead of ranking in this process")
+        .def(py::init<const std::string&>(), py::arg("socketPath") = "/tmp/textranker.sock")
+        .def("ExtractKeyParagraphs", &RankingClient::ExtractKeyParagraphs,
+            py::arg("input"), py::arg("paragraphs"), py::arg("entities"), py::arg("topK"), py::arg("similarity") = "log_overlap",
+            py::call_guard<py::gil_scoped_release>());
+#endif
 
     py::class_<Interval>(m, "Interval")
         .def(py::init<>())
@@ -25,14 +273,15 @@ PYBIND11_MODULE(textranker, m) {
         .def_readwrite("high", &Interval::high);
 
 
-    py::class_<IntervalTreeWrapper>(m, "IntervalTree")
+    py::class_<Interval64>(m, "Interval64", "Interval with 64 bit ends, for byte offsets of long books")
         .def(py::init<>())
-        .def("insert", py::overload_cast<const Interval&>(&IntervalTreeWrapper::insert),
-            "Insert an interval into the tree")
-        .def("insert", py::overload_cast<size_t, const Interval&>(&IntervalTreeWrapper::insert),
-            "Insert an interval with paragraph index into the tree")
-        .def("overlapSearch", &IntervalTreeWrapper::overlapSearch,
-            "Search for overlapping intervals - returns dict with interval and paragraph_index or None")
-        .def("inorder", &IntervalTreeWrapper::inorder, "Inorder traversal of the tree")
-        .def("isEmpty", &IntervalTreeWrapper::isEmpty, "Check if tree is empty");
-}
\ No newline at end of file
+        .def(py::init<long long, long long>())
+        .def_readwrite("low", &Interval64::low)
+        .def_readwrite("high", &Interval64::high);
+
+    BindIntervalTree<int, size_t>(m, "IntervalTree", "IntervalTreeSnapshot", "paragraph_index");
+    BindIntervalTree<long long, size_t>(m, "IntervalTree64", "IntervalTreeSnapshot64", "paragraph_index");
+    BindIntervalTree<int, LabelId>(m, "LabelIntervalTree", "LabelIntervalTreeSnapshot", "label (a label id, e.g. a spaCy label hash)");
+    BindIntervalTree<int, MentionId>(m, "MentionIntervalTree", "MentionIntervalTreeSnapshot",
+        "entity and mention (the payload is an (entity, mention) tuple)");
+}
@@ -0,0 +1,245 @@
+#include "chapter_detector.h"
+#include "text_ranker.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+std::vector<std::pair<int, int>> ChapterDetector::AddPage(const std::vector<double>& xs, const std::vector<double>& ys, const std::vector<int>& lengths)
+{
+	size_t count = std::min(xs.size(), std::min(ys.size(), lengths.size()));
+	if (count == 0) {
+		return std::vector<std::pair<int, int>>();  // an empty page has no edges
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (!mHasElements) {
+			mTop = mBottom = ys[i];
+			mHasElements = true;
+		}
+		mTop = std::min(mTop, ys[i]);
+		mBottom = std::max(mBottom, ys[i]);
+	}
+
+	mEdges.push_back({ true, xs[0], mPosition });
+	for (size_t i = 0; i < count; i++) {
+		mPosition += lengths[i] + 1;
+	}
+	mEdges.push_back({ false, ys[count - 1], mPosition });
+
+	return Flush(false);
+}
+
+std::vector<std::pair<int, int>> ChapterDetector::Finish(int textLength)
+{
+	std::vector<std::pair<int, int>> added = Flush(true);
+
+	// add the last chapter if it has content
+	if (mPosition > mChapterStart) {
+		mChapters.push_back({ mChapterStart, std::min(mPosition, textLength) });
+		added.push_back(mChapters.back());
+		mChapterStart = mPosition;
+	}
+	// create a chapter for the entire text if no chapters were found
+	if (mChapters.empty() && textLength > 0) {
+		mChapters.push_back({ 0, textLength });
+		added.push_back(mChapters.back());
+	}
+	return added;
+}
+
+int ChapterDetector::Decide(const Edge& edge, bool final) const
+{
+	if (edge.start) {
+		// the top can still go down to 0 (or anywhere if negative coordinates were seen)
+		if (final) {
+			return std::fabs(mTop - edge.value) >= mThreshold ? 1 : 0;
+		}
+		double lowest = mTop < 0 ? -std::numeric_limits<double>::infinity() : 0.0;
+		if (mTop <= edge.value - mThreshold || lowest >= edge.value + mThreshold)
+			return 1;
+		if (lowest > edge.value - mThreshold && mTop < edge.value + mThreshold)
+			return 0;
+		return -1;
+	}
+
+	// the bottom can only go up (up to maxY), and it is never above the last line of a page
+	if (mBottom - edge.value >= mThreshold)
+		return 1;
+	if (final || (mMaxY >= 0 && std::max(mMaxY, mBottom) - edge.value < mThreshold))
+		return 0;
+	return -1;
+}
+
+std::vector<std::pair<int, int>> ChapterDetector::Flush(bool final)
+{
+	std::vector<std::pair<int, int>> added;
+	for (; mNext < mEdges.size(); mNext++) {
+		const Edge& edge = mEdges[mNext];
+		int decision = Decide(edge, final);
+		if (decision < 0) {
+			break;
+		}
+		if (decision == 0) {
+			continue;
+		}
+		// a chapter start only closes the current chapter if it has content, a chapter end always does
+		if (!edge.start || edge.position > mChapterStart) {
+			mChapters.push_back({ mChapterStart, edge.position });
+			added.push_back(mChapters.back());
+		}
+		mChapterStart = edge.position;
+	}
+
+	// the decided edges are not needed anymore
+	if (mNext > 0 && mNext == mEdges.size()) {
+		mEdges.clear();
+		mNext = 0;
+	}
+	return added;
+}
+
+
+ChapterPipeline::ChapterPipeline(double threshold, double maxY, const ParagraphSegmenter& segmenter)
+	: mDetector(threshold, maxY), mSegmenter(segmenter), mCodePoints(0), mDone(false)
+{
+	mWorker = std::thread(&ChapterPipeline::Worker, this);
+}
+
+ChapterPipeline::~ChapterPipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDone = true;
+	}
+	mReady.notify_all();
+	if (mWorker.joinable()) {
+		mWorker.join();
+	}
+}
+
+size_t ChapterPipeline::AddPage(const std::vector<double>& xs, const std::vector<double>& ys, const std::vector<int>& lengths, const std::string& pageText)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mDone) {
+		throw std::logic_error("AddPage after Finish");  // the worker is gone, the chapters would never be segmented
+	}
+	mPageMarks.push_back({ mCodePoints, mText.size() });
+	mText += pageText;
+	mCodePoints += Utf8Index::CountCodePoints(pageText.data(), pageText.size());
+
+	Enqueue(mDetector.AddPage(xs, ys, lengths));
+	return mChapters.size();
+}
+
+const std::vector<std::pair<int, int>>& ChapterPipeline::Finish(int textLength)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Enqueue(mDetector.Finish(textLength));
+		mDone = true;
+	}
+	mReady.notify_all();
+	if (mWorker.joinable()) {
+		mWorker.join();
+	}
+	return mChapters;
+}
+
+std::vector<std::pair<int, int>> ChapterPipeline::GetChapters() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mChapters;
+}
+
+std::vector<std::pair<int, int>> ChapterPipeline::GetParagraphs(size_t chapter)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	if (chapter >= mChapters.size()) {
+		throw std::out_of_range("Chapter " + std::to_string(chapter) + " is not known yet");
+	}
+	mReady.wait(lock, [this, chapter]() { return (bool)mSegmented[chapter]; });
+	return mParagraphs[chapter];
+}
+
+std::map<int, std::set<EntityIndex>> ChapterPipeline::RankChapter(size_t chapter, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, const std::string& similarity)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	if (chapter >= mChapters.size()) {
+		throw std::out_of_range("Chapter " + std::to_string(chapter) + " is not known yet");
+	}
+	mReady.wait(lock, [this, chapter]() { return (bool)mSegmented[chapter]; });
+
+	// the spans are offsets in the whole document and the ranker only reads them, so it gets the document as it is
+	// instead of a copy of the chapter text. Pages are added on the caller's thread, holding the lock only blocks
+	// the worker from storing its next segmentation.
+	std::map<int, std::set<EntityIndex>> outputs;
+	for (auto& kp : mRanker.ExtractKeyParagraphs(mText, mParagraphs[chapter], entities, topK, similarity)) {
+		outputs[mRanker.GetParagraphIds()[kp.first]] = std::move(kp.second);
+	}
+	return outputs;
+}
+
+void ChapterPipeline::Enqueue(const std::vector<std::pair<int, int>>& chapters)
+{
+	for (const auto& chapter : chapters) {
+		mQueue.push_back(mChapters.size());
+		mChapters.push_back(chapter);
+		mParagraphs.push_back(std::vector<std::pair<int, int>>());
+		mSegmented.push_back(false);
+	}
+	if (!chapters.empty()) {
+		mReady.notify_all();
+	}
+}
+
+void ChapterPipeline::Worker()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mReady.wait(lock, [this]() { return mDone || !mQueue.empty(); });
+		if (mQueue.empty()) {
+			return;  // done and nothing left
+		}
+		size_t chapter = mQueue.front();
+		mQueue.pop_front();
+		int start = mChapters[chapter].first;
+		std::string text = Slice(start, mChapters[chapter].second);
+
+		// segment without holding the lock, so the next pages can be added meanwhile
+		lock.unlock();
+		std::vector<std::pair<int, int>> paragraphs = mSegmenter.Segment(text, SpanUnits::CodePoints);
+		for (auto& paragraph : paragraphs) {
+			paragraph.first += start;
+			paragraph.second += start;
+		}
+		lock.lock();
+
+		mParagraphs[chapter] = std::move(paragraphs);
+		mSegmented[chapter] = true;
+		mReady.notify_all();
+	}
+}
+
+std::string ChapterPipeline::Slice(int low, int high) const
+{
+	// byte of a code point - start from the page it is in
+	auto toByte = [this](size_t cp) -> size_t {
+		if (cp >= mCodePoints) {
+			return mText.size();
+		}
+		auto mark = std::upper_bound(mPageMarks.begin(), mPageMarks.end(), std::make_pair(cp, std::numeric_limits<size_t>::max())) - 1;
+		size_t byte = mark->second;
+		for (size_t n = cp - mark->first; n > 0; n--) {
+			byte++;
+			while (byte < mText.size() && ((unsigned char)mText[byte] & 0xC0) == 0x80) {
+				byte++;
+			}
+		}
+		return byte;
+	};
+	size_t from = toByte((size_t)std::max(low, 0));
+	size_t to = toByte((size_t)std::max(high, low));
+	return mText.substr(from, to - from);
+}
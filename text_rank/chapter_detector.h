@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Paragraph.h"
+#include "segmenter.h"
+#include "text_ranker.h"
+
+// Streaming port of StoryProcessor.extract_chapters_as_indices.
+// Pages are added one at a time as flat arrays of their layout elements (x, y, text length).
+// A chapter starts at the first element of a page whose x is at least threshold away from the top of
+// the pages (the smallest y of the whole document), and ends after the last element of a page whose y is
+// at least threshold above the bottom (the largest y). Every element advances the position by its length + 1.
+//
+// The top and the bottom are only known at the end, so a page edge is decided as soon as no later page
+// can change the result (the top only goes down to 0, the bottom only up to maxY) and the chapters
+// before the first undecided edge are returned right away. Finish gives exactly the python result.
+// maxY is the largest y an element can have (the page height), without it page ends stay open until Finish.
+class ChapterDetector
+{
+public:
+	explicit ChapterDetector(double threshold = 170.0, double maxY = -1.0)
+		: mThreshold(threshold), mMaxY(maxY), mTop(0), mBottom(0), mHasElements(false), mPosition(0), mChapterStart(0), mNext(0) { }
+
+	// Adds a page, returns the chapters that are now certain (code point spans)
+	std::vector<std::pair<int, int>> AddPage(const std::vector<double>& xs, const std::vector<double>& ys, const std::vector<int>& lengths);
+	// Ends the document, returns the remaining chapters. textLength is the length of the stripped text
+	std::vector<std::pair<int, int>> Finish(int textLength);
+
+	const std::vector<std::pair<int, int>>& GetChapters() const { return mChapters; }
+	int GetPosition() const { return mPosition; }
+
+private:
+	struct Edge {
+		bool start;    // start of page (tests x against the top) or end of page (tests y against the bottom)
+		double value;
+		int position;  // position of the edge in the text
+	};
+
+	int Decide(const Edge& edge, bool final) const;  // 1 - chapter boundary, 0 - not, -1 - not known yet
+	std::vector<std::pair<int, int>> Flush(bool final);
+
+	double mThreshold;
+	double mMaxY;  // < 0 - unknown
+	double mTop, mBottom;  // smallest and largest y seen so far
+	bool mHasElements;
+	int mPosition;  // position after the last added element
+	int mChapterStart;
+	std::vector<Edge> mEdges;  // page edges in text order, mEdges[mNext...] are not decided yet
+	size_t mNext;
+	std::vector<std::pair<int, int>> mChapters;
+};
+
+
+// Chapter detection -> paragraph segmentation -> ranking while the document is still being parsed.
+// Finished chapters are segmented on a worker thread, so parsing the next pages is not blocked.
+// Entities are only known after extraction, so ranking is a separate call per chapter.
+class ChapterPipeline
+{
+public:
+	explicit ChapterPipeline(double threshold = 170.0, double maxY = -1.0, const ParagraphSegmenter& segmenter = ParagraphSegmenter());
+	~ChapterPipeline();
+
+	// pageText is the text this page added to the document (the elements joined by a space)
+	// Returns the number of chapters known so far, throws std::logic_error after Finish
+	size_t AddPage(const std::vector<double>& xs, const std::vector<double>& ys, const std::vector<int>& lengths, const std::string& pageText);
+	// Ends the document and waits for the segmentation of every chapter
+	const std::vector<std::pair<int, int>>& Finish(int textLength);
+
+	std::vector<std::pair<int, int>> GetChapters() const;
+	// Paragraph spans (code points in the whole document) of a chapter, waits for it if needed
+	std::vector<std::pair<int, int>> GetParagraphs(size_t chapter);
+	// Ranks a chapter - keys are indices in GetParagraphs(chapter). Every call reuses the same ranker, so its
+	// workspace buffers are only grown by the largest chapter
+	std::map<int, std::set<EntityIndex>> RankChapter(size_t chapter, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, const std::string& similarity = "log_overlap");
+
+private:
+	void Enqueue(const std::vector<std::pair<int, int>>& chapters);
+	void Worker();
+	std::string Slice(int low, int high) const;  // text of a code point span (under mMutex)
+
+	ChapterDetector mDetector;
+	ParagraphSegmenter mSegmenter;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mReady;
+	std::string mText;  // everything added so far
+	std::vector<std::pair<size_t, size_t>> mPageMarks;  // (code point, byte) where every page starts
+	size_t mCodePoints;
+	std::vector<std::pair<int, int>> mChapters;
+	std::vector<std::vector<std::pair<int, int>>> mParagraphs;  // per chapter, filled by the worker
+	std::vector<bool> mSegmented;
+	std::deque<size_t> mQueue;
+	bool mDone;
+	TextRanker mRanker;  // used by RankChapter under mMutex
+	std::thread mWorker;
+};
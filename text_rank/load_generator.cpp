@@ -0,0 +1,81 @@
+// Load generator of the ranking daemon: every client thread sends requests one after the other on its own
+// connection and the latency of every request is recorded. Reports p50/p99 latency and throughput.
+//   g++ -std=c++14 -O2 -pthread -o load_generator load_generator.cpp ranking_client.cpp ranking_protocol.cpp
+//   ./load_generator --socket /tmp/textranker.sock --clients 8 --requests 200 --paragraphs 30
+#include "ranking_client.h"
+#include "random_chapter.h"
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+
+int main(int argc, char* argv[])
+{
+	std::string socketPath = "/tmp/textranker.sock";
+	int clients = 8, requests = 200, paragraphs = 30, entities = 20;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "--socket") socketPath = argv[i + 1];
+		else if (arg == "--clients") clients = std::atoi(argv[i + 1]);
+		else if (arg == "--requests") requests = std::atoi(argv[i + 1]);
+		else if (arg == "--paragraphs") paragraphs = std::atoi(argv[i + 1]);
+		else if (arg == "--entities") entities = std::atoi(argv[i + 1]);
+	}
+
+	std::mt19937 rng(7);
+	std::vector<Chapter> chapters;
+	for (int i = 0; i < 16; i++) {
+		chapters.push_back(RandomChapter(paragraphs, entities, rng));
+	}
+
+	std::vector<std::vector<double>> latencies(clients);
+	std::vector<int> failures(clients, 0);
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (int c = 0; c < clients; c++) {
+		threads.emplace_back([&, c]() {
+			try {
+				RankingClient client(socketPath);
+				for (int r = 0; r < requests; r++) {
+					const Chapter& chapter = chapters[(c + r) % chapters.size()];
+					auto begin = std::chrono::steady_clock::now();
+					client.ExtractKeyParagraphs(chapter.text, chapter.paragraphs, chapter.entities, (int)(paragraphs * 0.65));
+					latencies[c].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+				}
+			}
+			catch (const std::exception& e) {
+				std::cerr << "client " << c << ": " << e.what() << std::endl;
+				failures[c]++;
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<double> all;
+	for (const auto& client : latencies) {
+		all.insert(all.end(), client.begin(), client.end());
+	}
+	if (all.empty()) {
+		std::cerr << "no request succeeded" << std::endl;
+		return 1;
+	}
+	std::sort(all.begin(), all.end());
+	auto percentile = [&all](double p) { return all[std::min(all.size() - 1, (size_t)(p * all.size()))]; };
+
+	std::cout << all.size() << " requests, " << clients << " clients, " << paragraphs << " paragraphs each" << std::endl;
+	std::cout << "p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99) << " ms, max " << all.back() << " ms" << std::endl;
+	std::cout << "throughput " << all.size() / seconds << " requests/s" << std::endl;
+	int failed = 0;
+	for (int f : failures) {
+		failed += f;
+	}
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "local_push.h"
+#include <algorithm>
+
+
+template <typename Weight>
+void NeighbourLists::Build(const std::vector<Weight>& adjacency, const std::vector<Weight>& outWeightSum)
+{
+    size_t kDim = outWeightSum.size();
+    offsets.assign(kDim + 1, 0);
+    targets.clear();
+    probabilities.clear();
+    for (size_t i = 0; i < kDim; i++) {
+        if (outWeightSum[i] >= 1e-6) {
+            double out = static_cast<double>(outWeightSum[i]);
+            const Weight* row = adjacency.data() + i * kDim;
+            for (size_t j = 0; j < kDim; j++) {
+                if (i == j || row[j] <= 0)
+                    continue;
+                targets.push_back((uint32_t)j);
+                probabilities.push_back(row[j] / out);
+            }
+        }
+        offsets[i + 1] = targets.size();
+    }
+}
+
+template void NeighbourLists::Build<double>(const std::vector<double>&, const std::vector<double>&);
+template void NeighbourLists::Build<float>(const std::vector<float>&, const std::vector<float>&);
+
+
+void ForwardPush(const NeighbourLists& graph, const std::vector<std::pair<uint32_t, double>>& restart,
+    double alpha, double epsilon, PushState& state)
+{
+    size_t kDim = graph.Size();
+    if (state.estimate.size() != kDim) {
+        state.estimate.assign(kDim, 0.0);
+        state.residual.assign(kDim, 0.0);
+        state.queued.assign(kDim, 0);
+    }
+    else {
+        for (uint32_t i : state.touched) {
+            state.estimate[i] = 0.0;
+            state.residual[i] = 0.0;
+        }
+    }
+    state.touched.clear();
+    state.queue.clear();
+    state.pushes = 0;
+
+    double total = 0.0;
+    for (const auto& seed : restart) {
+        total += seed.second;
+    }
+    if (total <= 0) {
+        return;
+    }
+
+    auto touch = [&state](uint32_t i) {
+        if (state.estimate[i] == 0.0 && state.residual[i] == 0.0) {
+            state.touched.push_back(i);
+        }
+    };
+    // a paragraph is pushed while its residual is above epsilon per neighbour
+    auto enqueue = [&state, &graph, epsilon](uint32_t i) {
+        size_t degree = std::max<size_t>(1, graph.offsets[i + 1] - graph.offsets[i]);
+        if (!state.queued[i] && state.residual[i] > epsilon * degree) {
+            state.queued[i] = 1;
+            state.queue.push_back(i);
+        }
+    };
+
+    for (const auto& seed : restart) {
+        if (seed.first >= kDim || seed.second <= 0) {
+            continue;
+        }
+        touch(seed.first);
+        state.residual[seed.first] += seed.second / total;
+    }
+    for (const auto& seed : restart) {
+        if (seed.first < kDim) {
+            enqueue(seed.first);
+        }
+    }
+
+    // FIFO - every paragraph in the queue is pushed once per visit
+    for (size_t head = 0; head < state.queue.size(); head++) {
+        uint32_t u = state.queue[head];
+        state.queued[u] = 0;
+        double mass = state.residual[u];
+        state.residual[u] = 0.0;
+        state.estimate[u] += alpha * mass;
+        state.pushes++;
+
+        double spread = (1.0 - alpha) * mass;
+        for (size_t k = graph.offsets[u]; k < graph.offsets[u + 1]; k++) {
+            uint32_t v = graph.targets[k];
+            touch(v);
+            state.residual[v] += spread * graph.probabilities[k];
+            enqueue(v);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Personalized ranking with local forward push (Andersen, Chung, Lang).
+// Approximates the personalized PageRank x = alpha * s + (1 - alpha) * P^T x, where s is the restart
+// distribution (the paragraphs of the seed entities) and P moves to a neighbour by edge weight. Mass is
+// only pushed out of paragraphs whose residual is above epsilon * degree, so the work depends on the
+// neighbourhood of the seeds that is touched, not on the size of the graph. Paragraphs without outbound
+// links keep their alpha part and drop the rest, like they add nothing in CalcParagraphScores.
+
+
+// Neighbours of every paragraph with the probability of moving to them, built once per graph
+struct NeighbourLists {
+    std::vector<size_t> offsets;  // neighbours of i are [offsets[i], offsets[i + 1])
+    std::vector<uint32_t> targets;
+    std::vector<double> probabilities;
+
+    size_t Size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    // adjacency is the kDim x kDim matrix row major, kDim = outWeightSum.size()
+    template <typename Weight>
+    void Build(const std::vector<Weight>& adjacency, const std::vector<Weight>& outWeightSum);
+};
+
+// Buffers of one push, kept between pushes on the same thread. Only the touched entries are reset.
+struct PushState {
+    std::vector<double> estimate, residual;
+    std::vector<uint32_t> touched;  // paragraphs with a non zero estimate or residual
+    std::vector<uint32_t> queue;
+    std::vector<char> queued;
+    size_t pushes = 0;  // pushes of the last call
+};
+
+// Runs the push from restart ((paragraph, weight), any scale - it is normalized to 1).
+// Afterwards state.touched holds the paragraphs that were reached and state.estimate their scores.
+void ForwardPush(const NeighbourLists& graph, const std::vector<std::pair<uint32_t, double>>& restart,
+    double alpha, double epsilon, PushState& state);
@@ -1,8 +1,11 @@
 ﻿#include <iostream>
 #include "text_ranker.h"
+#include "chapter_detector.h"
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <chrono>
+#include <stdexcept>
 
 std::string loadTextFile(const std::string& filename) {
 	std::ifstream file(filename);
@@ -11,9 +14,106 @@ std::string loadTextFile(const std::string& filename) {
 	return buffer.str();
 }
 
+// StoryProcessor.extract_chapters_as_indices on the whole document (top and bottom known up front),
+// the reference of the streaming ChapterDetector
+static std::vector<std::pair<int, int>> ChaptersOfDocument(const std::vector<std::vector<double>>& xs,
+	const std::vector<std::vector<double>>& ys, const std::vector<std::vector<int>>& lengths, double threshold, int textLength)
+{
+	double top = ys[0][0], bottom = ys[0][0];
+	for (auto& page : ys) {
+		for (double y : page) {
+			top = std::min(top, y);
+			bottom = std::max(bottom, y);
+		}
+	}
+	std::vector<std::pair<int, int>> chapters;
+	int position = 0, start = 0;
+	for (size_t p = 0; p < xs.size(); p++) {
+		if (std::fabs(top - xs[p][0]) >= threshold) {
+			if (position > start) {
+				chapters.push_back({ start, position });
+			}
+			start = position;
+		}
+		for (int length : lengths[p]) {
+			position += length + 1;
+		}
+		if (bottom - ys[p].back() >= threshold) {
+			chapters.push_back({ start, position });
+			start = position;
+		}
+	}
+	if (position > start) {
+		chapters.push_back({ start, std::min(position, textLength) });
+	}
+	if (chapters.empty() && textLength > 0) {
+		chapters.push_back({ 0, textLength });
+	}
+	return chapters;
+}
+
+// Paragraphs split with std::string::find, the reference of ParagraphSegmenter - either blank lines or literal separators
+// (the longest one wins at the same position). Spans are trimmed code points, at least minLength long
+static std::vector<std::pair<int, int>> SplitParagraphs(const std::string& text, const std::vector<std::string>& separators, int minLength)
+{
+	const char* spaces = " \t\r\n\f\v";
+	std::vector<std::pair<int, int>> spans;
+	auto emit = [&](size_t low, size_t high) {
+		size_t first = text.find_first_not_of(spaces, low);
+		if (first >= high) {
+			return;
+		}
+		size_t last = text.find_last_not_of(spaces, high - 1) + 1;
+		int firstCp = (int)Utf8Index::CountCodePoints(text.data(), first);
+		int lastCp = (int)Utf8Index::CountCodePoints(text.data(), last);
+		if (lastCp - firstCp >= minLength) {
+			spans.push_back({ firstCp, lastCp });
+		}
+	};
+
+	size_t start = 0;
+	while (true) {
+		size_t at = std::string::npos, length = 0;
+		for (const std::string& separator : separators) {
+			if (separator == ParagraphSegmenter::kBlankLine) {
+				// a line break, whitespace that has another line break, up to the last one
+				for (size_t lineBreak = text.find('\n', start); lineBreak != std::string::npos; lineBreak = text.find('\n', lineBreak + 1)) {
+					size_t end = text.find_first_not_of(spaces, lineBreak + 1);
+					size_t lastBreak = text.rfind('\n', end == std::string::npos ? text.size() - 1 : end - 1);
+					if (lastBreak > lineBreak) {
+						at = lineBreak;
+						length = lastBreak + 1 - lineBreak;
+						break;
+					}
+				}
+				continue;
+			}
+			size_t found = text.find(separator, start);
+			if (found < at || (found == at && separator.size() > length)) {
+				at = found;
+				length = separator.size();
+			}
+		}
+		if (at == std::string::npos) {
+			break;
+		}
+		emit(start, at);
+		start = at + length;
+	}
+	emit(start, text.size());
+	return spans;
+}
+
 //using namespace std;
 
 int main() {
+	// every check prints yes or no, the exit code is not 0 if any of them failed
+	int failures = 0;
+	auto verdict = [&failures](bool ok) {
+		failures += !ok;
+		return ok ? "yes" : "no";
+	};
+
 	TextRanker textRanker;
 	std::string input = loadTextFile("text.txt");
 	std::vector <std::pair<int, int>> paragraphs = {
@@ -332,7 +432,7 @@ int main() {
 } };
 
 	// לסדר שמספר הפסקאות המחולצות יהיו לפי אחוזים
-	std::map<int, std::set<size_t>> outputs = textRanker.ExtractKeyParagraphs(input, paragraphs, entities, 25);
+	std::map<int, std::set<EntityIndex>> outputs = textRanker.ExtractKeyParagraphs(input, paragraphs, entities, 25);
 	std::cout << "Extracted Paragraphs:\n";
 	for (auto& m : outputs) {
 		std::cout << m.first << ": size= " << m.second.size() <<std::endl;
@@ -340,9 +440,399 @@ int main() {
 
 	std::cout << "output size " << outputs.size() << std::endl;
 
+	// accuracy check of the float mode - the same paragraphs must be selected
+	CompactTextRanker compactRanker;
+	std::map<int, std::set<EntityIndex>> compactOutputs = compactRanker.ExtractKeyParagraphs(input, paragraphs, entities, 25);
+	std::cout << "compact mode matches: " << verdict(compactOutputs == outputs) << std::endl;
+
+	// the approximate mode should find most of the same paragraphs
+	TextRanker approxRanker;
+	std::map<int, std::set<EntityIndex>> approxOutputs = approxRanker.ExtractKeyParagraphsApprox(input, paragraphs, entities, 25);
+	int common = 0;
+	for (auto& m : approxOutputs) {
+		common += (int)outputs.count(m.first);
+	}
+	std::cout << "approx mode overlap: " << common << "/" << outputs.size() << std::endl;
+	failures += common * 2 <= (int)outputs.size();  // most of them
+
+	// budget mode - the selected paragraphs must fit in the budget
+	BudgetOptions budgetOptions;
+	budgetOptions.budget = 3000;
+	TextRanker budgetRanker;
+	std::map<int, std::set<EntityIndex>> budgetOutputs = budgetRanker.ExtractKeyParagraphsBudget(input, paragraphs, entities, budgetOptions);
+	int budgetLength = 0;
+	for (auto& m : budgetOutputs) {
+		budgetLength += paragraphs[budgetRanker.GetParagraphIds()[m.first]].second - paragraphs[budgetRanker.GetParagraphIds()[m.first]].first;
+	}
+	std::cout << "budget mode: " << budgetOutputs.size() << " paragraphs, " << budgetLength << "/" << budgetOptions.budget << " characters" << std::endl;
+	failures += budgetOutputs.empty() || budgetLength > budgetOptions.budget;
+
+	// paragraphs about the same entities are redundant - with lambda 0.5 the selection covers more entity sets
+	// than the plain score order, the repeats are only picked to fill the budget
+	std::vector<size_t> entitySetsNum;
+	for (double lambda : { 1.0, 0.5 }) {
+		budgetOptions.lambda = lambda;
+		std::set<std::set<EntityIndex>> entitySets;
+		for (auto& m : budgetRanker.ExtractKeyParagraphsBudget(input, paragraphs, entities, budgetOptions)) {
+			if (!m.second.empty()) {
+				entitySets.insert(m.second);
+			}
+		}
+		entitySetsNum.push_back(entitySets.size());
+	}
+	std::cout << "budget mode redundancy: " << verdict(entitySetsNum[1] > entitySetsNum[0]) << ", " << entitySetsNum[1] << " entity sets, " << entitySetsNum[0] << " in score order" << std::endl;
+
+	// a lambda next to 0 still fills the budget, 0 itself is rejected
+	budgetOptions.lambda = 1e-9;
+	size_t lowLambdaNum = budgetRanker.ExtractKeyParagraphsBudget(input, paragraphs, entities, budgetOptions).size();
+	bool zeroRejected = false;
+	budgetOptions.lambda = 0;
+	try {
+		budgetRanker.ExtractKeyParagraphsBudget(input, paragraphs, entities, budgetOptions);
+	}
+	catch (const std::invalid_argument&) {
+		zeroRejected = true;
+	}
+	std::cout << "budget mode lambda: " << verdict(lowLambdaNum > 0 && zeroRejected) << ", " << lowLambdaNum << " paragraphs with lambda 1e-9" << std::endl;
+
+	// workspace mode - the same result, and no buffer grows once the workspace has seen the chapter
+	TextRanker workspaceRanker;
+	RankingWorkspace workspace;
+	workspaceRanker.ExtractKeyParagraphsInto(input, paragraphs, entities, 25, workspace);
+	size_t allocationsBefore = workspace.GetAllocationsNum();
+	const KeyParagraphs& workspaceOutputs = workspaceRanker.ExtractKeyParagraphsInto(input, paragraphs, entities, 25, workspace);
+	size_t allocations = workspace.GetAllocationsNum() - allocationsBefore;
+	std::cout << "workspace mode matches: " << verdict(workspaceOutputs.ToMap() == outputs) << ", allocations: " << allocations << std::endl;
+
+	// personalized mode - the batch gives the same paragraphs as ranking every character on its own
+	TextRanker personalRanker;
+	std::map<EntityIndex, std::map<int, std::set<EntityIndex>>> perEntity = personalRanker.ExtractKeyParagraphsPerEntity(input, paragraphs, entities, {}, 10);
+	int personalMatches = 0;
+	for (auto& m : perEntity) {
+		personalMatches += personalRanker.ExtractKeyParagraphsFor(input, paragraphs, entities, { m.first }, 10) == m.second;
+	}
+	std::cout << "personalized mode matches: " << personalMatches << "/" << perEntity.size() << std::endl;
+	failures += personalMatches != (int)perEntity.size();
+
+	// anytime mode - without limits it is ExtractKeyParagraphs, with half of its work the result is marked incomplete
+	TextRanker anytimeRanker;
+	AnytimeRanking fullRanking = anytimeRanker.ExtractKeyParagraphsAnytime(input, paragraphs, entities, 25);
+	AnytimeOptions anytimeOptions;
+	anytimeOptions.maxWork = fullRanking.work / 2;
+	AnytimeRanking cutRanking = anytimeRanker.ExtractKeyParagraphsAnytime(input, paragraphs, entities, 25, anytimeOptions);
+	common = 0;
+	for (auto& m : cutRanking.keyParagraphs) {
+		common += (int)outputs.count(m.first);
+	}
+	bool fullConverged = fullRanking.converged && fullRanking.residual < 1e-5 && fullRanking.iterations < 100;
+	std::cout << "anytime mode matches: " << verdict(fullRanking.complete && fullConverged && fullRanking.keyParagraphs == outputs)
+		<< ", converged after " << fullRanking.iterations << " iterations, half work: " << cutRanking.iterations << "/" << fullRanking.iterations << " iterations, residual " << cutRanking.residual
+		<< ", overlap " << common << "/" << outputs.size() << std::endl;
+
+	// the deadline holds - the fixture 20 times over is cut by a deadline of 20 ms, and has to come back within 10% of it
+	std::vector<std::pair<int, int>> longParagraphs;
+	std::vector<std::vector<std::pair<int, int>>> longEntities(entities.size());
+	int chapterLength = 0;
+	for (auto& p : paragraphs) {
+		chapterLength = std::max(chapterLength, p.second);
+	}
+	for (auto& mentions : entities) {
+		for (auto& m : mentions) {
+			chapterLength = std::max(chapterLength, m.second);
+		}
+	}
+	for (int copy = 0; copy < 20; copy++) {
+		int shift = copy * chapterLength;
+		for (auto& p : paragraphs) {
+			longParagraphs.push_back({ p.first + shift, p.second + shift });
+		}
+		for (size_t e = 0; e < entities.size(); e++) {
+			for (auto& m : entities[e]) {
+				longEntities[e].push_back({ m.first + shift, m.second + shift });
+			}
+		}
+	}
+	TextRanker deadlineRanker;
+	deadlineRanker.SetMaxParagraphs(0);
+	deadlineRanker.ExtractKeyParagraphsAnytime(input, longParagraphs, longEntities, 25);  // grows the workspace of the thread once
+	AnytimeOptions deadlineOptions;
+	deadlineOptions.deadlineMs = 20.0;
+	std::chrono::steady_clock::time_point deadlineStart = std::chrono::steady_clock::now();
+	AnytimeRanking deadlineRanking = deadlineRanker.ExtractKeyParagraphsAnytime(input, longParagraphs, longEntities, 25, deadlineOptions);
+	double deadlineElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - deadlineStart).count();
+	std::cout << "anytime deadline holds: " << verdict(deadlineElapsed <= 1.1 * deadlineOptions.deadlineMs && !deadlineRanking.complete) << std::endl;
+
+	// the approximate mode ranks the whole book by default, and mostly finds the paragraphs of the exact mode
+	TextRanker bookRanker;
+	std::map<int, std::set<EntityIndex>> bookOutputs = bookRanker.ExtractKeyParagraphsApprox(input, longParagraphs, longEntities, 25);
+	deadlineRanker.SetMaxParagraphs(0);
+	std::map<int, std::set<EntityIndex>> exactBookOutputs = deadlineRanker.ExtractKeyParagraphs(input, longParagraphs, longEntities, 25);
+	common = 0;
+	for (auto& m : bookOutputs) {
+		common += (int)exactBookOutputs.count(m.first);
+	}
+	std::cout << "approx mode whole book: " << verdict(bookOutputs.rbegin()->first >= 30) << ", " << bookRanker.GetScores().size()
+		<< " paragraphs ranked, overlap " << common << "/" << exactBookOutputs.size() << std::endl;
+
+	// mention normalization - fewer mentions to assign, and mostly the same key paragraphs
+	size_t mentionsNum = 0;
+	for (auto& mentions : entities) {
+		mentionsNum += mentions.size();
+	}
+	std::vector<std::pair<size_t, int>> normalization;  // (mentions, overlap) of every policy
+	const char* policies[] = { "dedupe", "drop_nested", "merge" };
+	for (const char* policy : policies) {
+		std::vector<std::vector<std::pair<int, int>>> normalized = entities;
+		NormalizeMentions(normalized, MentionPolicyFromName(policy));
+		size_t normalizedNum = 0;
+		for (auto& mentions : normalized) {
+			normalizedNum += mentions.size();
+		}
+		TextRanker normalizedRanker;
+		normalizedRanker.SetMentionPolicy(policy);
+		common = 0;
+		for (auto& m : normalizedRanker.ExtractKeyParagraphs(input, paragraphs, entities, 25)) {
+			common += (int)outputs.count(m.first);
+		}
+		normalization.push_back({ normalizedNum, common });
+	}
+	std::cout << "mentions: " << mentionsNum;
+	for (size_t i = 0; i < normalization.size(); i++) {
+		std::cout << ", " << policies[i] << " " << normalization[i].first << " (overlap " << normalization[i].second << "/" << outputs.size() << ")";
+	}
+	std::cout << std::endl;
+
+	// graph export - the CSR rows add up to the out-weights
+	TextRanker graphRanker;
+	RankingResult graphResult = graphRanker.ExtractKeyParagraphsWithGraph(input, paragraphs, entities, 25);
+	bool rowsMatch = graphResult.offsets.size() == graphResult.outWeights.size() + 1;
+	for (size_t i = 0; rowsMatch && i < graphResult.outWeights.size(); i++) {
+		double rowSum = 0.0;
+		for (int32_t l = graphResult.offsets[i]; l < graphResult.offsets[i + 1]; l++) {
+			rowSum += graphResult.weights[l];
+		}
+		rowsMatch = std::fabs(rowSum - graphResult.outWeights[i]) < 1e-9;
+	}
+	std::cout << "graph mode matches: " << verdict(graphResult.keyParagraphs == outputs && rowsMatch)
+		<< ", " << graphResult.weights.size() << " links of " << graphResult.scores.size() << " paragraphs" << std::endl;
+
+	// entity ranking - the paragraphs do not change, the most central entity comes first
+	TextRanker entityRanker;
+	auto withEntities = entityRanker.ExtractKeyParagraphsAndEntities(input, paragraphs, entities, 25, 3);
+	std::cout << "entity mode matches: " << verdict(withEntities.first == outputs) << ", central entities:";
+	for (auto& e : withEntities.second) {
+		std::cout << " " << e.first << " (" << e.second << ")";
+	}
+	std::cout << std::endl;
+
+	// interval tree order statistics against a scan of the mentions, the label of a mention is its entity
+	IntervalTree<int, LabelId> labelTree;
+	IntervalTree<int, MentionId> mentionTree;
+	std::vector<std::pair<int, uint64_t>> lows;
+	for (size_t e = 0; e < entities.size(); e++) {
+		for (size_t j = 0; j < entities[e].size(); j++) {
+			labelTree.insert(LabelId{ e }, Interval{ entities[e][j].first, entities[e][j].second });
+			mentionTree.insert(MentionId{ (uint32_t)e, (uint32_t)j }, Interval{ entities[e][j].first, entities[e][j].second });
+			lows.push_back({ entities[e][j].first, e });
+		}
+	}
+	std::sort(lows.begin(), lows.end());
+	bool treeMatches = labelTree.size() == lows.size();
+	for (int key = -1; treeMatches && key <= (int)input.size(); key += 7) {
+		size_t below = std::lower_bound(lows.begin(), lows.end(), std::make_pair(key, (uint64_t)0)) - lows.begin();
+		treeMatches = labelTree.rank(key) == below;
+	}
+	for (size_t k = 0; treeMatches && k <= lows.size(); k++) {
+		auto* node = labelTree.select(k);
+		treeMatches = k < lows.size() ? node != nullptr && node->GetInterval().low == lows[k].first : node == nullptr;
+	}
+	const int window = 500;
+	for (uint64_t label = 0; treeMatches && label <= entities.size(); label++) {
+		LabelId payload{ label };
+		std::vector<size_t> all = labelTree.histogram(0, (int)input.size(), window);
+		std::vector<size_t> ofLabel = labelTree.histogram(0, (int)input.size(), window, &payload);
+		std::vector<size_t> expectedAll((input.size() + window - 1) / window, 0), expectedLabel(expectedAll.size(), 0);
+		for (auto& low : lows) {
+			expectedAll[low.first / window]++;
+			expectedLabel[low.first / window] += low.second == label;
+		}
+		treeMatches = all == expectedAll && ofLabel == expectedLabel;
+	}
+	for (size_t e = 0; treeMatches && e < entities.size(); e++) {
+		for (size_t j = 0; treeMatches && j < entities[e].size(); j++) {
+			treeMatches = mentionTree.payloadCount(MentionId{ (uint32_t)e, (uint32_t)j }, 0, (int)input.size()) == 1;
+		}
+	}
+	std::cout << "interval tree matches: " << verdict(treeMatches) << ", " << lows.size() << " mentions" << std::endl;
+
+	// chapters of a layout made of the fixture paragraphs - page by page they are the ones of the whole document
+	std::vector<std::vector<double>> pageXs, pageYs;
+	std::vector<std::vector<int>> pageLengths;
+	std::vector<std::string> pageTexts;
+	for (size_t i = 0; i < paragraphs.size(); ) {
+		size_t page = pageXs.size();
+		size_t elements = std::min(paragraphs.size() - i, page % 5 == 3 ? (size_t)1 : (size_t)3);  // short pages end a chapter
+		pageXs.push_back({});
+		pageYs.push_back({});
+		pageLengths.push_back({});
+		pageTexts.push_back("");
+		for (size_t k = 0; k < elements; k++, i++) {
+			std::string element = input.substr(paragraphs[i].first, paragraphs[i].second - paragraphs[i].first);
+			pageXs.back().push_back(k == 0 && page % 4 == 2 ? 300.0 : 120.0);  // an indented first line starts a chapter
+			pageYs.back().push_back(100.0 + 200.0 * k);
+			pageLengths.back().push_back((int)Utf8Index::CountCodePoints(element.data(), element.size()));
+			pageTexts.back() += element + " ";
+		}
+	}
+	int documentLength = 0;
+	for (auto& page : pageLengths) {
+		for (int length : page) {
+			documentLength += length + 1;
+		}
+	}
+	documentLength--;  // the stripped text has no trailing space
+	std::vector<std::pair<int, int>> documentChapters = ChaptersOfDocument(pageXs, pageYs, pageLengths, 170.0, documentLength);
+
+	ChapterDetector detector(170.0, 500.0);
+	ChapterPipeline pipeline(170.0, 500.0);
+	std::vector<std::pair<int, int>> streamedChapters;
+	size_t beforeFinish = 0;
+	for (size_t page = 0; page < pageXs.size(); page++) {
+		auto added = detector.AddPage(pageXs[page], pageYs[page], pageLengths[page]);
+		streamedChapters.insert(streamedChapters.end(), added.begin(), added.end());
+		beforeFinish = pipeline.AddPage(pageXs[page], pageYs[page], pageLengths[page], pageTexts[page]);
+	}
+	size_t streamedEarly = streamedChapters.size();
+	auto rest = detector.Finish(documentLength);
+	streamedChapters.insert(streamedChapters.end(), rest.begin(), rest.end());
+	bool chaptersMatch = streamedChapters == documentChapters && pipeline.Finish(documentLength) == documentChapters;
+	std::cout << "streamed chapters match: " << verdict(chaptersMatch) << ", " << documentChapters.size()
+		<< " chapters, " << streamedEarly << "/" << beforeFinish << " before the end of the document" << std::endl;
+
+	// ranking the chapters on the pipeline's ranker gives what a new ranker gives on every chapter, the mentions
+	// are moved to code points in the document like the paragraphs
+	std::string documentText;
+	for (auto& pageText : pageTexts) {
+		documentText += pageText;
+	}
+	std::vector<int> paragraphStarts;
+	int paragraphStart = 0;
+	for (auto& paragraph : paragraphs) {
+		paragraphStarts.push_back(paragraphStart);
+		paragraphStart += (int)Utf8Index::CountCodePoints(input.data() + paragraph.first, paragraph.second - paragraph.first) + 1;
+	}
+	std::vector<std::vector<std::pair<int, int>>> documentEntities(entities.size());
+	for (size_t e = 0; e < entities.size(); e++) {
+		for (auto& mention : entities[e]) {
+			for (size_t i = 0; i < paragraphs.size(); i++) {
+				if (paragraphs[i].first <= mention.first && mention.second <= paragraphs[i].second) {
+					int low = paragraphStarts[i] + (int)Utf8Index::CountCodePoints(input.data() + paragraphs[i].first, mention.first - paragraphs[i].first);
+					documentEntities[e].push_back({ low, low + (int)Utf8Index::CountCodePoints(input.data() + mention.first, mention.second - mention.first) });
+				}
+			}
+		}
+	}
+	bool pipelineRanksMatch = true;
+	size_t pipelineKeyNum = 0;
+	for (size_t chapter = 0; chapter < documentChapters.size(); chapter++) {
+		std::map<int, std::set<EntityIndex>> ranked = pipeline.RankChapter(chapter, documentEntities, 3);
+		TextRanker chapterRanker;
+		std::map<int, std::set<EntityIndex>> expected;
+		for (auto& kp : chapterRanker.ExtractKeyParagraphs(documentText, pipeline.GetParagraphs(chapter), documentEntities, 3)) {
+			expected[chapterRanker.GetParagraphIds()[kp.first]] = kp.second;
+		}
+		pipelineRanksMatch = pipelineRanksMatch && ranked == expected;
+		pipelineKeyNum += ranked.size();
+	}
+	bool addAfterFinishThrows = false;
+	try {
+		pipeline.AddPage(pageXs[0], pageYs[0], pageLengths[0], pageTexts[0]);
+	}
+	catch (const std::logic_error&) {
+		addAfterFinishThrows = true;
+	}
+	std::cout << "pipeline ranks match: " << verdict(pipelineRanksMatch && addAfterFinishThrows) << ", "
+		<< pipelineKeyNum << " key paragraphs" << std::endl;
+
+	// native segmentation against std::string::find, on the fixture paragraphs joined by different separators
+	const char* joints[] = { "\n\n", "\n \t\n\n", "\r\n\r\n", "###PARA###", "\n", "\n\n\n", " ###PARA###\n\n" };
+	std::string document;
+	for (size_t i = 0; i < paragraphs.size(); i++) {
+		document += input.substr(paragraphs[i].first, paragraphs[i].second - paragraphs[i].first);
+		document += joints[i % (sizeof(joints) / sizeof(joints[0]))];
+	}
+	std::vector<std::vector<std::string>> separatorSets = {
+		{ ParagraphSegmenter::kBlankLine }, { "###PARA###" }, { "\n\n", "###PARA###", "\n\n\n" } };
+	bool segmentsMatch = true;
+	size_t segmentsNum = 0;
+	for (auto& separators : separatorSets) {
+		for (int minLength : { 0, 40 }) {
+			std::vector<std::pair<int, int>> segments = ParagraphSegmenter(separators, minLength).Segment(document);
+			segmentsMatch = segmentsMatch && segments == SplitParagraphs(document, separators, minLength);
+			segmentsNum += segments.size();
+		}
+	}
+	std::cout << "segmenter matches: " << verdict(segmentsMatch) << ", " << segmentsNum << " paragraphs" << std::endl;
+
+	// code points <-> bytes against a walk over the lead bytes, on the fixture and on 1 to 4 byte characters
+	bool offsetsMatch = true;
+	std::string mixed;
+	for (int i = 0; i < 300; i++) {
+		mixed += i % 7 == 0 ? "a \xc3\xa9\xe2\x82\xac" : "\xf0\x9f\x98\x80\xd7\xa9x";
+	}
+	for (const std::string* text : { &input, &mixed }) {
+		Utf8Index index(*text);
+		std::vector<size_t> starts;  // byte offset of every code point
+		for (size_t b = 0; b < text->size(); b++) {
+			if (((unsigned char)(*text)[b] & 0xC0) != 0x80) {
+				starts.push_back(b);
+			}
+		}
+		offsetsMatch = offsetsMatch && !index.IsAscii() && index.CodePointsNum() == starts.size();
+		for (size_t cp = 0; offsetsMatch && cp <= starts.size() + 1; cp++) {
+			offsetsMatch = index.ByteOffset(cp) == (cp < starts.size() ? starts[cp] : text->size());
+		}
+		for (size_t b = 0, cp = 0; offsetsMatch && b <= text->size(); b++) {
+			while (cp + 1 < starts.size() && starts[cp + 1] <= b) {
+				cp++;
+			}
+			offsetsMatch = index.CodePointOffset(b) == (b < text->size() ? cp : starts.size());
+		}
+		std::vector<std::pair<int, int>> spans;
+		for (size_t cp = 0; cp + 40 <= starts.size(); cp += 37) {
+			spans.push_back({ (int)cp, (int)cp + 40 });
+		}
+		offsetsMatch = offsetsMatch && index.ToCodePoints(index.ToBytes(spans)) == spans;
+	}
+	std::cout << "utf8 index round trip: " << verdict(offsetsMatch) << std::endl;
+
+	// byte spans rank like the code point spans they stand for - the minimum length is counted in code points
+	Utf8Index inputIndex(input);
+	std::vector<std::vector<std::pair<int, int>>> entityBytes;
+	for (auto& mentions : entities) {
+		entityBytes.push_back(inputIndex.ToBytes(mentions));
+	}
+	std::vector<std::pair<int, int>> shortParagraphs;  // 36 code points, but at least 40 bytes
+	for (auto& p : paragraphs) {
+		std::pair<int, int> bytes = inputIndex.ToBytes({ { p.first, p.first + 36 } })[0];
+		if (bytes.second - bytes.first >= 40) {
+			shortParagraphs.push_back(bytes);
+		}
+	}
+	TextRanker utf8Ranker;
+	bool unitsMatch = utf8Ranker.ExtractKeyParagraphsUtf8(input, inputIndex.ToBytes(paragraphs), "bytes", entityBytes, "bytes", 25) == outputs
+		&& utf8Ranker.ExtractKeyParagraphsUtf8(input, inputIndex.ToBytes(paragraphs), "bytes", entities, "codepoints", 25) == outputs
+		&& utf8Ranker.ExtractKeyParagraphsUtf8(input, paragraphs, "codepoints", entityBytes, "bytes", 25) == outputs
+		&& !shortParagraphs.empty() && utf8Ranker.ExtractKeyParagraphsUtf8(input, shortParagraphs, "bytes", entityBytes, "bytes", 25).empty();
+	std::cout << "utf8 mode matches: " << verdict(unitsMatch) << ", " << shortParagraphs.size() << " short paragraphs dropped" << std::endl;
+
 	//for (const std::string& para : outputs) {
 	//	std::cout << para << "\n\n\n\n";
 	//}
 
+	if (failures > 0) {
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
 	return 0;
 }
\ No newline at end of file
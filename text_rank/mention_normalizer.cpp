@@ -0,0 +1,145 @@
+#include "mention_normalizer.h"
+#include "parallel.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+// below this many mentions NormalizeMentions does not start threads
+static const size_t kParallelMinMentions = 1 << 16;
+
+MentionPolicy MentionPolicyFromName(const std::string& name)
+{
+    if (name == "keep")
+        return MentionPolicy::Keep;
+    if (name == "dedupe")
+        return MentionPolicy::Dedupe;
+    if (name == "drop_nested")
+        return MentionPolicy::DropNested;
+    if (name == "merge")
+        return MentionPolicy::Merge;
+    throw std::invalid_argument("Unknown mention policy: " + name);
+}
+
+const char* MentionPolicyName(MentionPolicy policy)
+{
+    switch (policy) {
+    case MentionPolicy::Dedupe:
+        return "dedupe";
+    case MentionPolicy::DropNested:
+        return "drop_nested";
+    case MentionPolicy::Merge:
+        return "merge";
+    case MentionPolicy::Keep:
+    default:
+        return "keep";
+    }
+}
+
+void NormalizeEntityMentions(std::vector<std::pair<int, int>>& mentions, MentionPolicy policy)
+{
+    mentions.resize(NormalizeEntityMentions(mentions.data(), mentions.size(), policy));
+}
+
+size_t NormalizeEntityMentions(std::pair<int, int>* mentions, size_t size, MentionPolicy policy)
+{
+    if (policy == MentionPolicy::Keep || size < 2) {
+        return size;
+    }
+
+    // DropNested wants the longest span of a start first, then a span is nested iff it ends before the furthest end so far
+    if (policy == MentionPolicy::DropNested) {
+        std::sort(mentions, mentions + size, [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+            return a.first != b.first ? a.first < b.first : a.second > b.second;
+        });
+    }
+    else {
+        std::sort(mentions, mentions + size);
+    }
+
+    size_t kept = 0;
+    switch (policy) {
+    case MentionPolicy::Dedupe:
+        kept = std::unique(mentions, mentions + size) - mentions;
+        break;
+    case MentionPolicy::DropNested: {
+        int furthest = mentions[0].second;
+        kept = 1;
+        for (size_t i = 1; i < size; i++) {
+            if (mentions[i].second > furthest) {
+                furthest = mentions[i].second;
+                mentions[kept++] = mentions[i];
+            }
+        }
+        break;
+    }
+    case MentionPolicy::Merge:
+        kept = 1;
+        for (size_t i = 1; i < size; i++) {
+            std::pair<int, int>& last = mentions[kept - 1];
+            if (mentions[i].first < last.second) {
+                last.second = std::max(last.second, mentions[i].second);
+            }
+            else {
+                mentions[kept++] = mentions[i];
+            }
+        }
+        break;
+    default:
+        kept = size;
+        break;
+    }
+    return kept;
+}
+
+void NormalizeMentions(std::vector<std::vector<std::pair<int, int>>>& entities, MentionPolicy policy, int threads)
+{
+    if (policy == MentionPolicy::Keep) {
+        return;
+    }
+    size_t mentionsNum = 0;
+    for (const auto& mentions : entities) {
+        mentionsNum += mentions.size();
+    }
+    if (mentionsNum < kParallelMinMentions) {
+        threads = 1;
+    }
+    // entities have very different numbers of mentions (the main characters), so they are taken one at a time
+    ParallelForEach(entities.size(), threads, [&](size_t e, int) {
+        NormalizeEntityMentions(entities[e], policy);
+    });
+}
+
+void NormalizeMentions(std::vector<std::pair<int, int>>& spans, std::vector<uint32_t>& offsets, MentionPolicy policy, int threads)
+{
+    if (policy == MentionPolicy::Keep || offsets.size() < 2) {
+        return;
+    }
+    size_t entitiesNum = offsets.size() - 1;
+    if (spans.size() < kParallelMinMentions || threads == 1) {
+        // one pass - every entity is normalized where it is and moved down over the mentions that were dropped before it
+        size_t next = 0;
+        for (size_t e = 0; e < entitiesNum; e++) {
+            size_t begin = offsets[e], end = offsets[e + 1];
+            size_t kept = NormalizeEntityMentions(spans.data() + begin, end - begin, policy);
+            std::copy(spans.begin() + begin, spans.begin() + begin + kept, spans.begin() + next);
+            offsets[e] = (uint32_t)next;
+            next += kept;
+        }
+        offsets[entitiesNum] = (uint32_t)next;
+        spans.resize(next);
+        return;
+    }
+
+    std::vector<uint32_t> kept(entitiesNum);
+    ParallelForEach(entitiesNum, threads, [&](size_t e, int) {
+        kept[e] = (uint32_t)NormalizeEntityMentions(spans.data() + offsets[e], offsets[e + 1] - offsets[e], policy);
+    });
+    size_t next = 0;
+    for (size_t e = 0; e < entitiesNum; e++) {
+        std::copy(spans.begin() + offsets[e], spans.begin() + offsets[e] + kept[e], spans.begin() + next);
+        offsets[e] = (uint32_t)next;
+        next += kept[e];
+    }
+    offsets[entitiesNum] = (uint32_t)next;
+    spans.resize(next);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+// Normalization of the mention spans of every entity before they are assigned to paragraphs.
+// Mention lists from NER + coreference have exact duplicates and spans inside or across other spans of the
+// same entity ({5935,5937} in {5935,6019}), and each of them is another tree query and another mention count.
+// Spans are [start, end) - spans that only touch are not overlapping. Spans of different entities are never compared.
+
+
+enum class MentionPolicy {
+    Keep,        // nothing changes, not even the order
+    Dedupe,      // exact duplicates are dropped
+    DropNested,  // spans inside another span of the entity (or equal to it) are dropped, partial overlaps stay
+    Merge        // overlapping spans of the entity are coalesced into their union
+};
+
+// Parse the name used by the python side ("keep", "dedupe", "drop_nested", "merge").
+// Throws std::invalid_argument for an unknown name.
+MentionPolicy MentionPolicyFromName(const std::string& name);
+const char* MentionPolicyName(MentionPolicy policy);
+
+// Sorts the mentions of one entity by (start, end) and applies policy, in place
+void NormalizeEntityMentions(std::vector<std::pair<int, int>>& mentions, MentionPolicy policy);
+// The same on mentions[0 .. size), returns how many are kept (at the front)
+size_t NormalizeEntityMentions(std::pair<int, int>* mentions, size_t size, MentionPolicy policy);
+
+// NormalizeEntityMentions of every entity, in parallel across entities (threads 0 - one per core).
+// Inputs with few mentions run on the calling thread, starting the threads would take longer than the sorts.
+void NormalizeMentions(std::vector<std::vector<std::pair<int, int>>>& entities, MentionPolicy policy, int threads = 0);
+// NormalizeMentions on the mentions of all entities in one array (the mentions of entity e are
+// spans[offsets[e] .. offsets[e + 1])), both are compacted in place. Allocates only when it runs in parallel.
+void NormalizeMentions(std::vector<std::pair<int, int>>& spans, std::vector<uint32_t>& offsets, MentionPolicy policy, int threads = 0);
@@ -0,0 +1,172 @@
+#include "monte_carlo.h"
+#include "parallel.h"
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+
+// Indices of the k best scores, equal scores ordered by position (same order as the exact mode)
+static std::vector<size_t> TopKIndices(const std::vector<double>& scores, size_t k)
+{
+    std::vector<size_t> ids(scores.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = i;
+    }
+    k = std::min(k, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + k, ids.end(), [&scores](size_t a, size_t b) {
+        if (scores[a] != scores[b])
+            return scores[a] > scores[b];
+        return a < b;
+    });
+    ids.resize(k);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+template <typename Weight>
+int EstimateScoresMonteCarlo(const NeighbourLists& graph, const std::vector<double>& restart,
+    double d, int topK, const MonteCarloOptions& options, std::vector<Weight>& scores)
+{
+    size_t kDim = graph.Size();
+    scores.assign(kDim, 0);
+    if (kDim == 0 || options.walksPerRound < 1 || options.maxWalks < 1) {
+        return 0;
+    }
+
+    // alias tables of the neighbours of every paragraph (Vose), so a step costs one random pick
+    const std::vector<size_t>& offsets = graph.offsets;
+    const std::vector<uint32_t>& neighbours = graph.targets;
+    std::vector<uint32_t> alias(neighbours.size());
+    std::vector<float> probability(neighbours.size());
+    std::vector<double> scaled;
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < kDim; i++) {
+        size_t first = offsets[i];
+        size_t count = offsets[i + 1] - first;
+        if (count == 0) {
+            continue;
+        }
+
+        double sum = 0.0;
+        for (size_t k = 0; k < count; k++) {
+            sum += graph.probabilities[first + k];
+        }
+        scaled.resize(count);
+        small.clear();
+        large.clear();
+        for (size_t k = 0; k < count; k++) {
+            scaled[k] = graph.probabilities[first + k] * count / sum;
+            (scaled[k] < 1.0 ? small : large).push_back((uint32_t)k);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            probability[first + s] = (float)scaled[s];
+            alias[first + s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // what is left is 1 up to rounding
+        for (uint32_t k : large) {
+            probability[first + k] = 1.0f;
+            alias[first + k] = k;
+        }
+        for (uint32_t k : small) {
+            probability[first + k] = 1.0f;
+            alias[first + k] = k;
+        }
+    }
+
+    int threads = options.threads > 0 ? options.threads : DefaultThreadsNum();
+    std::vector<std::mt19937_64> rngs;
+    for (int t = 0; t < threads; t++) {
+        rngs.emplace_back(options.seed + 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1));
+    }
+    std::vector<std::vector<double>> threadVisits(threads, std::vector<double>(kDim, 0.0));
+
+    std::vector<double> visits(kDim, 0.0);
+    std::vector<double> estimate(kDim, 0.0);
+    std::vector<double> prevEstimate;
+    std::vector<size_t> prevTop;
+    int stable = 0;
+    int walks = 0;
+
+    while (walks < options.maxWalks) {
+        int roundWalks = std::min(walks == 0 ? options.walksPerRound : walks, options.maxWalks - walks);
+
+        ParallelFor(kDim, threads, [&](size_t begin, size_t end, int t) {
+            std::mt19937_64& rng = rngs[t];
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            std::vector<double>& local = threadVisits[t];
+            std::fill(local.begin(), local.end(), 0.0);
+
+            for (size_t start = begin; start < end; start++) {
+                double weight = restart[start];
+                for (int w = 0; w < roundWalks; w++) {
+                    size_t cur = start;
+                    while (true) {
+                        local[cur] += weight;
+                        if (offsets[cur] == offsets[cur + 1] || uniform(rng) >= d)
+                            break;
+                        size_t count = offsets[cur + 1] - offsets[cur];
+                        double u = uniform(rng) * count;
+                        size_t pick = std::min((size_t)u, count - 1);
+                        size_t k = offsets[cur] + pick;
+                        if (u - pick >= probability[k]) {
+                            k = offsets[cur] + alias[k];
+                        }
+                        cur = neighbours[k];
+                    }
+                }
+            }
+        });
+
+        for (int t = 0; t < threads; t++) {
+            for (size_t i = 0; i < kDim; i++) {
+                visits[i] += threadVisits[t][i];
+            }
+        }
+        walks += roundWalks;
+        for (size_t i = 0; i < kDim; i++) {
+            estimate[i] = visits[i] / walks;
+        }
+
+        std::vector<size_t> top = TopKIndices(estimate, topK > 0 ? (size_t)topK : 0);
+        bool converged = false;
+        if (options.stableRounds > 0) {
+            // both lists are sorted, count the paragraphs that stayed in the top-K
+            std::vector<size_t> kept;
+            std::set_intersection(top.begin(), top.end(), prevTop.begin(), prevTop.end(), std::back_inserter(kept));
+            bool same = !prevTop.empty() && kept.size() >= options.stableOverlap * top.size();
+            stable = same ? stable + 1 : 0;
+            converged = stable >= options.stableRounds;
+        }
+        if (options.tolerance > 0 && !prevEstimate.empty()) {
+            double maxChange = 0.0;
+            for (size_t i : top) {
+                maxChange = std::max(maxChange, std::fabs(estimate[i] - prevEstimate[i]) / std::max(estimate[i], 1e-12));
+            }
+            converged = converged || maxChange < options.tolerance;
+        }
+        prevTop.swap(top);
+        prevEstimate = estimate;
+        if (converged) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < kDim; i++) {
+        scores[i] = static_cast<Weight>(estimate[i]);
+    }
+    return walks;
+}
+
+
+template int EstimateScoresMonteCarlo<double>(const NeighbourLists&, const std::vector<double>&,
+    double, int, const MonteCarloOptions&, std::vector<double>&);
+template int EstimateScoresMonteCarlo<float>(const NeighbourLists&, const std::vector<double>&,
+    double, int, const MonteCarloOptions&, std::vector<float>&);
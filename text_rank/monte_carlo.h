@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "local_push.h"
+
+// Options of the approximate (Monte-Carlo) ranking mode.
+// Walks are started from every paragraph in rounds, and the estimate is checked after every round.
+// Rounds double the number of walks, so each check compares the estimate with one from half the samples.
+struct MonteCarloOptions {
+    int walksPerRound = 8;     // walks started from every paragraph in the first round, every later round doubles the total
+    int maxWalks = 512;        // sample budget - walks per paragraph
+    double tolerance = 0.0;    // error target - stop when no top-K score moved more than this (relative) in a round, 0 - off
+    int stableRounds = 2;      // stop when the top-K set was stable for this many rounds in a row, 0 - off
+    double stableOverlap = 0.9;  // the top-K set is stable when at least this part of it is unchanged by a round
+    int threads = 0;           // 0 - one per core
+    uint64_t seed = 2024;      // same seed and threads give the same result
+    int maxParagraphs = 0;     // longest input (in paragraphs) that is ranked, 0 - no limit
+};
+
+// Estimates the fixed point of x = restart + d * P^T x (what CalcParagraphScores iterates to) with
+// random walks with restart: a walk from paragraph i carries restart[i], continues with probability d
+// to a neighbour j picked by the probability of the link in graph and adds its weight to every paragraph
+// it visits. Paragraphs without outbound links end the walk, like they add nothing in the exact sum.
+// Each thread has its own RNG and visit counters, they are merged after every round.
+// Returns the number of walks per paragraph that were used.
+template <typename Weight>
+int EstimateScoresMonteCarlo(const NeighbourLists& graph, const std::vector<double>& restart,
+    double d, int topK, const MonteCarloOptions& options, std::vector<Weight>& scores);
@@ -0,0 +1,77 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// Number of worker threads to use when the caller passes 0
+inline int DefaultThreadsNum()
+{
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : (int)hw;
+}
+
+// Split [0, count) into one contiguous block per thread and run fn(begin, end, thread) on each.
+// The blocks are the same for the same (count, threads), so per-thread seeds give reproducible results.
+// With a single block fn runs on the calling thread.
+template <typename Fn>
+void ParallelFor(size_t count, int threads, Fn fn)
+{
+    if (threads <= 0) {
+        threads = DefaultThreadsNum();
+    }
+    size_t blocks = std::min(count, (size_t)threads);
+    if (blocks <= 1) {
+        fn((size_t)0, count, 0);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(blocks - 1);
+    size_t blockSize = (count + blocks - 1) / blocks;
+    for (size_t t = 1; t < blocks; t++) {
+        size_t begin = t * blockSize;
+        size_t end = std::min(count, begin + blockSize);
+        if (begin >= end) {
+            break;
+        }
+        workers.emplace_back([&fn, begin, end, t]() { fn(begin, end, (int)t); });
+    }
+    fn((size_t)0, std::min(count, blockSize), 0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Run fn(i, thread) for every i in [0, count), the threads take the next index when they are done.
+// For work items of very different sizes (chapters, characters), where fixed blocks would leave threads idle.
+template <typename Fn>
+void ParallelForEach(size_t count, int threads, Fn fn)
+{
+    if (threads <= 0) {
+        threads = DefaultThreadsNum();
+    }
+    size_t workersNum = std::min(count, (size_t)threads);
+    if (workersNum <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i, 0);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&fn, &next, count](int t) {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i, t);
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(workersNum - 1);
+    for (size_t t = 1; t < workersNum; t++) {
+        workers.emplace_back(work, (int)t);
+    }
+    work(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
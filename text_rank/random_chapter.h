@@ -0,0 +1,38 @@
+#pragma once
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Synthetic chapters for benchmark.cpp and load_generator.cpp - not part of the python module
+
+struct Chapter {
+	std::string text;
+	std::vector<std::pair<int, int>> paragraphs;
+	std::vector<std::vector<std::pair<int, int>>> entities;
+};
+
+// Paragraphs of 40-400 chars, entity mentions spread with a long tail (few main characters, many minor ones)
+inline Chapter RandomChapter(int paragraphsNum, int entitiesNum, std::mt19937& rng)
+{
+	Chapter chapter;
+	std::uniform_int_distribution<int> paragraphLen(40, 400);
+	int pos = 0;
+	for (int i = 0; i < paragraphsNum; i++) {
+		int len = paragraphLen(rng);
+		chapter.paragraphs.push_back({ pos, pos + len });
+		pos += len;
+	}
+	chapter.text.assign(pos, 'a');
+
+	std::uniform_int_distribution<int> position(0, pos - 10);
+	chapter.entities.resize(entitiesNum);
+	for (int e = 0; e < entitiesNum; e++) {
+		int mentions = 1 + paragraphsNum / (2 * (e + 1));
+		for (int m = 0; m < mentions; m++) {
+			int low = position(rng);
+			chapter.entities[e].push_back({ low, low + 5 });
+		}
+	}
+	return chapter;
+}
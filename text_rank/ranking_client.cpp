@@ -0,0 +1,65 @@
+#include "ranking_client.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+RankingClient::RankingClient(const std::string& socketPath)
+	: mFd(-1), mNextId(0)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("Bad socket path: " + socketPath);
+	}
+	std::strcpy(address.sun_path, socketPath.c_str());
+
+	mFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (mFd < 0) {
+		throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+	}
+	if (connect(mFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		std::string error = std::strerror(errno);
+		close(mFd);
+		throw std::runtime_error("Cannot connect to " + socketPath + ": " + error);
+	}
+}
+
+RankingClient::~RankingClient()
+{
+	if (mFd >= 0) {
+		close(mFd);
+	}
+}
+
+std::map<int, std::set<EntityIndex>> RankingClient::ExtractKeyParagraphs(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, const std::string& similarity)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	RankingRequest request;
+	request.id = mNextId++;
+	request.topK = topK;
+	request.similarity = similarity;
+	request.input = input;
+	request.paragraphs = paragraphs;
+	request.entities = entities;
+
+	mFrame.clear();
+	EncodeRequest(request, mFrame);
+	if (!WriteAll(mFd, mFrame.data(), mFrame.size())) {
+		throw std::runtime_error("The ranking daemon closed the connection");
+	}
+
+	RankingResponse response;
+	if (!ReadFrame(mFd, mBody) || !DecodeResponse(mBody, response) || response.id != request.id) {
+		throw std::runtime_error("Bad response from the ranking daemon");
+	}
+	if (!response.ok) {
+		throw std::runtime_error(response.error);
+	}
+	return std::move(response.keyParagraphs);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include "ranking_protocol.h"
+
+// Client of the ranking daemon (ranking_server.h) - the python binding only forwards the call, so the
+// web workers do not hold any ranking state. One request at a time per client, use a client per thread
+// for concurrent requests. POSIX only.
+class RankingClient
+{
+public:
+	// Connects to the daemon, throws std::runtime_error
+	explicit RankingClient(const std::string& socketPath);
+	~RankingClient();
+	RankingClient(const RankingClient&) = delete;
+	RankingClient& operator=(const RankingClient&) = delete;
+
+	// Same as TextRanker::ExtractKeyParagraphs, throws std::runtime_error if the daemon fails
+	std::map<int, std::set<EntityIndex>> ExtractKeyParagraphs(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, const std::string& similarity = "log_overlap");
+
+private:
+	int mFd;
+	uint32_t mNextId;
+	std::mutex mMutex;
+	std::string mFrame;  // buffers kept between calls
+	std::string mBody;
+};
@@ -0,0 +1,61 @@
+// Standalone ranking daemon, see ranking_server.h. Not part of the python module or the VS project (POSIX only):
+//   g++ -std=c++14 -O2 -pthread -o ranking_daemon ranking_daemon.cpp ranking_server.cpp ranking_protocol.cpp text_ranker.cpp similarity.cpp monte_carlo.cpp utf8_index.cpp segmenter.cpp ranking_workspace.cpp local_push.cpp mention_normalizer.cpp
+//   ./ranking_daemon --socket /tmp/textranker.sock --threads 4 --batch 16 --window-us 200 --mention-policy drop_nested
+#include "ranking_server.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
+
+
+static void Usage()
+{
+	std::cerr << "usage: ranking_daemon [--socket path] [--threads n] [--batch n] [--window-us n] [--max-paragraphs n] [--mention-policy name]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	RankingServerOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			Usage();
+			return 2;
+		}
+		std::string value = argv[++i];
+		if (arg == "--socket") options.socketPath = value;
+		else if (arg == "--threads") options.threads = std::atoi(value.c_str());
+		else if (arg == "--batch") options.maxBatch = std::atoi(value.c_str());
+		else if (arg == "--window-us") options.batchWindowUs = std::atoi(value.c_str());
+		else if (arg == "--max-paragraphs") options.maxParagraphs = std::atoi(value.c_str());
+		else if (arg == "--mention-policy") options.mentionPolicy = value;
+		else {
+			Usage();
+			return 2;
+		}
+	}
+
+	// the signals are only taken by sigwait below, every thread inherits the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	RankingServer server(options);
+	try {
+		server.Start();
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "listening on " << options.socketPath << std::endl;
+
+	int signal = 0;
+	sigwait(&signals, &signal);
+	server.Stop();
+	std::cout << "stopped: " << server.GetRequestsNum() << " requests in " << server.GetBatchesNum() << " batches" << std::endl;
+	return 0;
+}
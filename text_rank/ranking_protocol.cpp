@@ -0,0 +1,254 @@
+#include "ranking_protocol.h"
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace {
+
+class Writer
+{
+public:
+	explicit Writer(std::string& output) : mOutput(output), mStart(output.size())
+	{
+		U32(0);  // the length, set by Finish
+	}
+
+	void U32(uint32_t value) { mOutput.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+	void I32(int32_t value) { mOutput.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+	void U8(uint8_t value) { mOutput.push_back((char)value); }
+	void Str(const std::string& value)
+	{
+		U32((uint32_t)value.size());
+		mOutput.append(value);
+	}
+	void Spans(const std::vector<std::pair<int, int>>& spans)
+	{
+		U32((uint32_t)spans.size());
+		for (const auto& span : spans) {
+			I32(span.first);
+			I32(span.second);
+		}
+	}
+	void Finish()
+	{
+		uint32_t length = (uint32_t)(mOutput.size() - mStart - sizeof(uint32_t));
+		std::memcpy(&mOutput[mStart], &length, sizeof(length));
+	}
+
+private:
+	std::string& mOutput;
+	size_t mStart;
+};
+
+// Every read checks the remaining size, a malformed body only sets the failed flag
+class Reader
+{
+public:
+	explicit Reader(const std::string& input) : mData(input.data()), mLeft(input.size()), mFailed(false) { }
+
+	uint32_t U32() { uint32_t value = 0; Read(&value, sizeof(value)); return value; }
+	int32_t I32() { int32_t value = 0; Read(&value, sizeof(value)); return value; }
+	uint8_t U8() { uint8_t value = 0; Read(&value, sizeof(value)); return value; }
+	std::string Str()
+	{
+		uint32_t size = U32();
+		if (!Check(size)) {
+			return std::string();
+		}
+		std::string value(mData, size);
+		Skip(size);
+		return value;
+	}
+	bool Spans(std::vector<std::pair<int, int>>& spans)
+	{
+		uint32_t count = U32();
+		if (!Check((size_t)count * 2 * sizeof(int32_t))) {
+			return false;
+		}
+		spans.resize(count);
+		for (auto& span : spans) {
+			span.first = I32();
+			span.second = I32();
+		}
+		return !mFailed;
+	}
+	// size more bytes are left in the body
+	bool Check(size_t size)
+	{
+		if (size > mLeft) {
+			mFailed = true;
+		}
+		return !mFailed;
+	}
+	bool Ok() const { return !mFailed; }
+	bool Done() const { return !mFailed && mLeft == 0; }
+
+private:
+	void Read(void* output, size_t size)
+	{
+		if (Check(size)) {
+			std::memcpy(output, mData, size);
+			Skip(size);
+		}
+	}
+	void Skip(size_t size)
+	{
+		mData += size;
+		mLeft -= size;
+	}
+
+	const char* mData;
+	size_t mLeft;
+	bool mFailed;
+};
+
+}
+
+
+void EncodeRequest(const RankingRequest& request, std::string& frame)
+{
+	Writer writer(frame);
+	writer.U32(request.id);
+	writer.I32(request.topK);
+	writer.Str(request.similarity);
+	writer.Str(request.input);
+	writer.Spans(request.paragraphs);
+	writer.U32((uint32_t)request.entities.size());
+	for (const auto& mentions : request.entities) {
+		writer.Spans(mentions);
+	}
+	writer.Finish();
+}
+
+bool DecodeRequest(const std::string& body, RankingRequest& request)
+{
+	Reader reader(body);
+	request.id = reader.U32();
+	request.topK = reader.I32();
+	request.similarity = reader.Str();
+	request.input = reader.Str();
+	if (!reader.Spans(request.paragraphs)) {
+		return false;
+	}
+	uint32_t entitiesNum = reader.U32();
+	if (!reader.Check((size_t)entitiesNum * sizeof(uint32_t))) {
+		return false;
+	}
+	request.entities.resize(entitiesNum);
+	for (auto& mentions : request.entities) {
+		if (!reader.Spans(mentions)) {
+			return false;
+		}
+	}
+	return reader.Done();
+}
+
+void EncodeResponse(const RankingResponse& response, std::string& frame)
+{
+	Writer writer(frame);
+	writer.U32(response.id);
+	writer.U8(response.ok ? 0 : 1);
+	if (!response.ok) {
+		writer.Str(response.error);
+	}
+	else {
+		writer.U32((uint32_t)response.keyParagraphs.size());
+		for (const auto& kp : response.keyParagraphs) {
+			writer.I32(kp.first);
+			writer.U32((uint32_t)kp.second.size());
+			for (EntityIndex entity : kp.second) {
+				writer.U32(entity);
+			}
+		}
+	}
+	writer.Finish();
+}
+
+void EncodeResponse(uint32_t id, const KeyParagraphs& keyParagraphs, std::string& frame)
+{
+	Writer writer(frame);
+	writer.U32(id);
+	writer.U8(0);
+	writer.U32((uint32_t)keyParagraphs.size());
+	for (size_t i = 0; i < keyParagraphs.size(); i++) {
+		writer.I32(keyParagraphs.paragraphs[i]);
+		writer.U32(keyParagraphs.entityOffsets[i + 1] - keyParagraphs.entityOffsets[i]);
+		for (uint32_t e = keyParagraphs.entityOffsets[i]; e < keyParagraphs.entityOffsets[i + 1]; e++) {
+			writer.U32(keyParagraphs.entities[e]);
+		}
+	}
+	writer.Finish();
+}
+
+bool DecodeResponse(const std::string& body, RankingResponse& response)
+{
+	Reader reader(body);
+	response.id = reader.U32();
+	response.ok = reader.U8() == 0;
+	response.keyParagraphs.clear();
+	if (!response.ok) {
+		response.error = reader.Str();
+		return reader.Done();
+	}
+
+	uint32_t count = reader.U32();
+	for (uint32_t i = 0; i < count && reader.Ok(); i++) {
+		int paragraph = reader.I32();
+		uint32_t entitiesNum = reader.U32();
+		if (!reader.Check((size_t)entitiesNum * sizeof(uint32_t))) {
+			return false;
+		}
+		std::set<EntityIndex>& entities = response.keyParagraphs[paragraph];
+		for (uint32_t e = 0; e < entitiesNum; e++) {
+			entities.insert(entities.end(), reader.U32());
+		}
+	}
+	return reader.Done();
+}
+
+
+static bool ReadAll(int fd, char* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = recv(fd, data, size, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+bool ReadFrame(int fd, std::string& body)
+{
+	uint32_t length;
+	if (!ReadAll(fd, reinterpret_cast<char*>(&length), sizeof(length)) || length > kMaxFrameSize) {
+		return false;
+	}
+	body.resize(length);
+	return length == 0 || ReadAll(fd, &body[0], length);
+}
+
+bool WriteAll(int fd, const char* data, size_t size)
+{
+	while (size > 0) {
+		// MSG_NOSIGNAL - a closed peer is an error, not a SIGPIPE
+		ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
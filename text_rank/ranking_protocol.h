@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+#include "Paragraph.h"
+#include "ranking_workspace.h"
+
+// Binary format of the ranking daemon (ranking_server.h) and its client (ranking_client.h).
+// Every message is a frame: u32 body length + body. Integers are in host byte order, both ends are on
+// the same machine (Unix domain socket). str is u32 length + bytes, span is (i32 low, i32 high).
+//   request:  u32 id, i32 topK, str similarity, str input, u32 n + n spans (paragraphs),
+//             u32 m + m * (u32 k + k spans) (mentions of every entity)
+//   response: u32 id, u8 status, then for 0 (ok) u32 n + n * (i32 paragraph, u32 k + k * u32 entity)
+//             and for anything else str error
+// Requests are answered in any order, the id matches a response to its request.
+
+static const uint32_t kMaxFrameSize = 256u << 20;
+
+struct RankingRequest {
+	uint32_t id = 0;
+	int topK = 0;
+	std::string similarity = "log_overlap";
+	std::string input;
+	std::vector<std::pair<int, int>> paragraphs;
+	std::vector<std::vector<std::pair<int, int>>> entities;
+};
+
+struct RankingResponse {
+	uint32_t id = 0;
+	bool ok = true;
+	std::string error;
+	std::map<int, std::set<EntityIndex>> keyParagraphs;
+};
+
+// Encode* append a whole frame (with its length) to frame, Decode* parse a body and return false if it is malformed
+void EncodeRequest(const RankingRequest& request, std::string& frame);
+bool DecodeRequest(const std::string& body, RankingRequest& request);
+void EncodeResponse(const RankingResponse& response, std::string& frame);
+void EncodeResponse(uint32_t id, const KeyParagraphs& keyParagraphs, std::string& frame);  // an ok response, without the map
+bool DecodeResponse(const std::string& body, RankingResponse& response);
+
+// Blocking socket I/O. ReadFrame returns false on end of stream, an error or a frame over kMaxFrameSize
+bool ReadFrame(int fd, std::string& body);
+bool WriteAll(int fd, const char* data, size_t size);
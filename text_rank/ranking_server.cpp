@@ -0,0 +1,209 @@
+#include "ranking_server.h"
+#include "text_ranker.h"
+#include "parallel.h"
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+RankingServer::Connection::~Connection()
+{
+	close(fd);
+}
+
+
+RankingServer::RankingServer(const RankingServerOptions& options)
+	: mOptions(options), mListenFd(-1), mStopping(false), mRequestsNum(0), mBatchesNum(0)
+{
+	if (mOptions.threads <= 0) {
+		mOptions.threads = DefaultThreadsNum();
+	}
+	if (mOptions.maxBatch < 1) {
+		mOptions.maxBatch = 1;
+	}
+}
+
+RankingServer::~RankingServer()
+{
+	Stop();
+}
+
+void RankingServer::Start()
+{
+	MentionPolicyFromName(mOptions.mentionPolicy);  // throws here rather than in a ranking thread
+
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (mOptions.socketPath.empty() || mOptions.socketPath.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("Bad socket path: " + mOptions.socketPath);
+	}
+	std::strcpy(address.sun_path, mOptions.socketPath.c_str());
+
+	mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (mListenFd < 0) {
+		throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+	}
+	unlink(mOptions.socketPath.c_str());  // left over from a daemon that was killed
+	if (bind(mListenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(mListenFd, 128) < 0) {
+		std::string error = std::strerror(errno);
+		close(mListenFd);
+		mListenFd = -1;
+		throw std::runtime_error("Cannot listen on " + mOptions.socketPath + ": " + error);
+	}
+
+	for (int t = 0; t < mOptions.threads; t++) {
+		mWorkers.emplace_back(&RankingServer::WorkerLoop, this);
+	}
+	mAcceptThread = std::thread(&RankingServer::AcceptLoop, this);
+}
+
+void RankingServer::Stop()
+{
+	if (mListenFd < 0) {
+		return;
+	}
+	{
+		// under the jobs lock, a worker cannot miss it between checking the queue and waiting
+		std::lock_guard<std::mutex> lock(mJobsMutex);
+		if (mStopping.exchange(true)) {
+			return;
+		}
+		mJobsReady.notify_all();
+	}
+
+	// wake the accept and every blocked read, the readers see mStopping and end
+	shutdown(mListenFd, SHUT_RDWR);
+	mAcceptThread.join();
+	{
+		std::unique_lock<std::mutex> lock(mConnectionsMutex);
+		for (auto& connection : mConnections) {
+			shutdown(connection->fd, SHUT_RD);
+		}
+		mReadersDone.wait(lock, [this]() { return mConnections.empty(); });
+	}
+
+	// the queue is not taking new jobs anymore, the workers (woken above) finish it and end
+	for (std::thread& worker : mWorkers) {
+		worker.join();
+	}
+
+	close(mListenFd);
+	unlink(mOptions.socketPath.c_str());
+	mListenFd = -1;
+}
+
+void RankingServer::AcceptLoop()
+{
+	while (!mStopping) {
+		int fd = accept(mListenFd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;  // the socket was shut down
+		}
+		auto connection = std::make_shared<Connection>(fd);
+
+		std::lock_guard<std::mutex> lock(mConnectionsMutex);
+		if (mStopping) {
+			break;
+		}
+		mConnections.push_back(connection);
+		std::thread(&RankingServer::ReadLoop, this, connection).detach();
+	}
+}
+
+void RankingServer::ReadLoop(std::shared_ptr<Connection> connection)
+{
+	std::string body;
+	while (!mStopping && ReadFrame(connection->fd, body)) {
+		Job job;
+		job.connection = connection;
+		if (!DecodeRequest(body, job.request)) {
+			break;  // the stream cannot be trusted after a bad frame
+		}
+		{
+			std::lock_guard<std::mutex> lock(mJobsMutex);
+			mJobs.push_back(std::move(job));
+		}
+		mJobsReady.notify_one();
+	}
+	// the peer stopped sending, the responses of its queued requests can still be written
+	shutdown(connection->fd, SHUT_RD);
+
+	std::lock_guard<std::mutex> lock(mConnectionsMutex);
+	mConnections.erase(std::find(mConnections.begin(), mConnections.end(), connection));
+	mReadersDone.notify_all();
+}
+
+void RankingServer::WorkerLoop()
+{
+	TextRanker ranker;
+	ranker.SetMaxParagraphs(mOptions.maxParagraphs);
+	ranker.SetMentionPolicy(mOptions.mentionPolicy);
+	RankingWorkspace workspace;  // ranking does not allocate once it has seen the largest chapter
+	std::vector<Job> batch;
+	std::map<Connection*, std::string> frames;  // responses of the batch per connection
+
+	std::unique_lock<std::mutex> lock(mJobsMutex);
+	while (true) {
+		mJobsReady.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+		if (mJobs.empty()) {
+			return;  // stopping and nothing left
+		}
+		// under load (more than one request is waiting) a partial batch waits a little for more requests -
+		// they are ranked and answered together. A single request is taken right away
+		if (mJobs.size() > 1 && (int)mJobs.size() < mOptions.maxBatch && mOptions.batchWindowUs > 0 && !mStopping) {
+			mJobsReady.wait_for(lock, std::chrono::microseconds(mOptions.batchWindowUs),
+				[this]() { return mStopping || (int)mJobs.size() >= mOptions.maxBatch; });
+		}
+		while (!mJobs.empty() && (int)batch.size() < mOptions.maxBatch) {
+			batch.push_back(std::move(mJobs.front()));
+			mJobs.pop_front();
+		}
+		if (batch.empty()) {
+			continue;  // another thread took them
+		}
+		if (!mJobs.empty()) {
+			mJobsReady.notify_one();
+		}
+		lock.unlock();
+
+		for (Job& job : batch) {
+			std::string& frame = frames[job.connection.get()];
+			try {
+				const KeyParagraphs& keyParagraphs = ranker.ExtractKeyParagraphsInto(job.request.input, job.request.paragraphs,
+					job.request.entities, job.request.topK, workspace, SimilarityKindFromName(job.request.similarity));
+				EncodeResponse(job.request.id, keyParagraphs, frame);
+			}
+			catch (const std::exception& e) {
+				RankingResponse response;
+				response.id = job.request.id;
+				response.ok = false;
+				response.error = e.what();
+				EncodeResponse(response, frame);
+			}
+		}
+		for (Job& job : batch) {
+			auto frame = frames.find(job.connection.get());
+			if (frame == frames.end()) {
+				continue;  // already written
+			}
+			std::lock_guard<std::mutex> writeLock(job.connection->writeMutex);
+			WriteAll(job.connection->fd, frame->second.data(), frame->second.size());
+			frames.erase(frame);
+		}
+		mRequestsNum += batch.size();
+		mBatchesNum++;
+		batch.clear();
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "ranking_protocol.h"
+
+struct RankingServerOptions {
+	std::string socketPath = "/tmp/textranker.sock";
+	int threads = 0;            // ranking threads, 0 - one per core
+	int maxBatch = 16;          // most requests a thread takes at once
+	int batchWindowUs = 200;    // how long a thread waits for more requests under load before it runs a partial batch, 0 - never
+	int maxParagraphs = 30;     // TextRanker::SetMaxParagraphs of the rankers
+	std::string mentionPolicy = "keep";  // TextRanker::SetMentionPolicy of the rankers
+};
+
+// Ranking daemon - a single process holds the rankers instead of every python worker importing the module.
+// Every connection has a reader thread that decodes requests into a shared queue. A fixed pool of ranking
+// threads takes them in batches (under load waiting up to batchWindowUs to fill one), ranks them with a ranker and a workspace
+// (ranking_workspace.h) that every thread keeps between requests, and writes the responses of a batch with one write per connection.
+// Requests on one connection can be pipelined, the responses carry the request id. POSIX only.
+class RankingServer
+{
+public:
+	explicit RankingServer(const RankingServerOptions& options);
+	~RankingServer();
+
+	// Binds the socket and starts the threads, throws std::runtime_error (std::invalid_argument for an unknown mentionPolicy)
+	void Start();
+	// Stops accepting, answers the queued requests and joins every thread
+	void Stop();
+
+	uint64_t GetRequestsNum() const { return mRequestsNum; }
+	uint64_t GetBatchesNum() const { return mBatchesNum; }
+
+private:
+	struct Connection {
+		explicit Connection(int fd) : fd(fd) { }
+		~Connection();  // closes fd - after the reader and the last queued job are done with it
+		int fd;
+		std::mutex writeMutex;
+	};
+	struct Job {
+		std::shared_ptr<Connection> connection;
+		RankingRequest request;
+	};
+
+	void AcceptLoop();
+	void ReadLoop(std::shared_ptr<Connection> connection);
+	void WorkerLoop();
+
+	RankingServerOptions mOptions;
+	int mListenFd;
+	std::atomic<bool> mStopping;
+	std::thread mAcceptThread;
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mConnectionsMutex;
+	std::condition_variable mReadersDone;
+	std::vector<std::shared_ptr<Connection>> mConnections;  // open connections, each has a (detached) reader
+
+	std::mutex mJobsMutex;
+	std::condition_variable mJobsReady;
+	std::deque<Job> mJobs;
+
+	std::atomic<uint64_t> mRequestsNum, mBatchesNum;
+};
@@ -0,0 +1,124 @@
+#include "ranking_workspace.h"
+#include <algorithm>
+
+
+bool IntervalArena::Reserve(size_t size)
+{
+    if (size <= mNodes.capacity()) {
+        return false;
+    }
+    mNodes.reserve(std::max(size, 2 * mNodes.capacity()));
+    return true;
+}
+
+void IntervalArena::Update(int node)
+{
+    ArenaNode& n = mNodes[node];
+    n.height = 1 + std::max(Height(n.left), Height(n.right));
+    n.max = n.i.high;
+    if (n.left >= 0 && mNodes[n.left].max > n.max) {
+        n.max = mNodes[n.left].max;
+    }
+    if (n.right >= 0 && mNodes[n.right].max > n.max) {
+        n.max = mNodes[n.right].max;
+    }
+}
+
+int IntervalArena::RightRotate(int y)
+{
+    if (y < 0 || mNodes[y].left < 0) return y;
+    int x = mNodes[y].left;
+    int t2 = mNodes[x].right;
+    mNodes[x].right = y;
+    mNodes[y].left = t2;
+    Update(y);
+    Update(x);
+    return x;
+}
+
+int IntervalArena::LeftRotate(int x)
+{
+    if (x < 0 || mNodes[x].right < 0) return x;
+    int y = mNodes[x].right;
+    int t2 = mNodes[y].left;
+    mNodes[y].left = x;
+    mNodes[x].right = t2;
+    Update(x);
+    Update(y);
+    return y;
+}
+
+// AVL insertion by low (equal lows go right) on indices, as Node::insertPersistent orders the tree
+int IntervalArena::Insert(int root, int node)
+{
+    if (root < 0)
+        return node;
+
+    int low = mNodes[node].i.low;
+    if (low < mNodes[root].i.low) {
+        int left = Insert(mNodes[root].left, node);
+        mNodes[root].left = left;
+    }
+    else {
+        int right = Insert(mNodes[root].right, node);
+        mNodes[root].right = right;
+    }
+
+    Update(root);
+    int balance = Height(mNodes[root].left) - Height(mNodes[root].right);
+    int left = mNodes[root].left, right = mNodes[root].right;
+
+    // Left Left Case
+    if (balance > 1 && left >= 0 && low < mNodes[left].i.low)
+        return RightRotate(root);
+
+    // Right Right Case
+    if (balance < -1 && right >= 0 && low >= mNodes[right].i.low)
+        return LeftRotate(root);
+
+    // Left Right Case
+    if (balance > 1 && left >= 0 && low >= mNodes[left].i.low) {
+        mNodes[root].left = LeftRotate(left);
+        return RightRotate(root);
+    }
+
+    // Right Left Case
+    if (balance < -1 && right >= 0 && low < mNodes[right].i.low) {
+        mNodes[root].right = RightRotate(right);
+        return LeftRotate(root);
+    }
+
+    return root;
+}
+
+void IntervalArena::Insert(int payload, Interval interval)
+{
+    mNodes.push_back({ interval, interval.high, -1, -1, 1, payload });
+    mRoot = Insert(mRoot, (int)mNodes.size() - 1);
+}
+
+// Node::overlapSearch on indices
+int IntervalArena::OverlapSearch(Interval interval) const
+{
+    int node = mRoot;
+    while (node >= 0) {
+        const ArenaNode& n = mNodes[node];
+        if (Node::isOverlapping(n.i, interval))
+            return n.payload;
+        if (n.left >= 0 && mNodes[n.left].max >= interval.low)
+            node = n.left;
+        else
+            node = n.right;
+    }
+    return -1;
+}
+
+
+std::map<int, std::set<EntityIndex>> KeyParagraphs::ToMap() const
+{
+    std::map<int, std::set<EntityIndex>> outputs;
+    for (size_t i = 0; i < paragraphs.size(); i++) {
+        outputs[paragraphs[i]] = std::set<EntityIndex>(entities.begin() + entityOffsets[i], entities.begin() + entityOffsets[i + 1]);
+    }
+    return outputs;
+}
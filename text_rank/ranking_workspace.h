@@ -0,0 +1,150 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+#include <cstdint>
+#include "Paragraph.h"
+#include "IntervalTree.h"
+#include "similarity.h"
+
+// Buffers of a BasicTextRanker call - every ranking runs on a workspace (the ranker keeps one for its own
+// calls, ExtractKeyParagraphsInto takes the caller's). Every buffer keeps its capacity between
+// calls, so once a workspace has seen a chapter of some size, ranking chapters up to that size does not touch
+// the heap: no per-paragraph std::set or vector nodes (the mentions are kept as flat CSR arrays), no shared_ptr
+// tree nodes (the same AVL tree is built in a node array), one flat adjacency matrix and flat results.
+// GetAllocationsNum counts the times a buffer had to grow - it stays the same on a steady-state call.
+// A workspace is used by one call at a time, keep one per thread.
+
+
+// Mention counts of one paragraph, a view into the workspace (sorted by entity, what the similarity policies walk)
+class MentionSpan {
+public:
+    typedef std::pair<EntityIndex, uint32_t> value_type;
+
+    MentionSpan() : mData(nullptr), mSize(0) { }
+    MentionSpan(const value_type* data, size_t size) : mData(data), mSize(size) { }
+    size_t size() const { return mSize; }
+    const value_type& operator[](size_t i) const { return mData[i]; }
+    const value_type* begin() const { return mData; }
+    const value_type* end() const { return mData + mSize; }
+
+private:
+    const value_type* mData;
+    size_t mSize;
+};
+
+// What the similarity policies need from a paragraph
+class ParagraphView {
+public:
+    ParagraphView() : mMentions(0) { }
+    ParagraphView(MentionSpan counts, size_t mentions) : mCounts(counts), mMentions(mentions) { }
+    size_t GetCharsNum() const { return mMentions; }
+    const MentionSpan& GetMentionCounts() const { return mCounts; }
+
+private:
+    MentionSpan mCounts;
+    size_t mMentions;
+};
+
+
+// The interval tree of IntervalTree.h in a node array - same insertion, rotations and search, so the
+// mentions are assigned to exactly the same paragraphs, but clearing it keeps the nodes' memory.
+class IntervalArena {
+public:
+    IntervalArena() : mRoot(-1) { }
+    void Clear() { mNodes.clear(); mRoot = -1; }
+    // Returns true if the node array had to grow
+    bool Reserve(size_t size);
+    void Insert(int payload, Interval interval);
+    // Payload of an overlapping interval, -1 if none
+    int OverlapSearch(Interval interval) const;
+
+private:
+    struct ArenaNode {
+        Interval i;
+        int max;
+        int left, right;
+        int height;
+        int payload;
+    };
+
+    int Height(int node) const { return node < 0 ? 0 : mNodes[node].height; }
+    void Update(int node);
+    int RightRotate(int y);
+    int LeftRotate(int x);
+    int Insert(int root, int node);
+
+    std::vector<ArenaNode> mNodes;
+    int mRoot;
+};
+
+
+// Result of a workspace call: the key paragraphs in increasing order (the keys of the map
+// ExtractKeyParagraphs returns) and the entities of each
+struct KeyParagraphs {
+    std::vector<int> paragraphs;
+    std::vector<uint32_t> entityOffsets;  // entities of paragraphs[i] are entities[entityOffsets[i] .. entityOffsets[i + 1])
+    std::vector<EntityIndex> entities;
+
+    size_t size() const { return paragraphs.size(); }
+    std::map<int, std::set<EntityIndex>> ToMap() const;  // allocates, for callers that want the usual result
+};
+
+
+template <typename Weight>
+class BasicRankingWorkspace {
+public:
+    BasicRankingWorkspace() : mSimilarity(mViews), mAllocations(0), mUnassignedMentions(0) { }
+    BasicRankingWorkspace(const BasicRankingWorkspace&) = delete;  // mSimilarity points into the workspace
+    BasicRankingWorkspace& operator=(const BasicRankingWorkspace&) = delete;
+
+    const KeyParagraphs& GetResult() const { return mResult; }
+    // Index in the paragraphs that were passed in of every ranked paragraph (by key)
+    const std::vector<int>& GetParagraphIds() const { return mParagraphIds; }
+    const std::vector<Weight>& GetScores() const { return mScores; }
+    // Mentions of the last call that are not in any ranked paragraph
+    size_t GetUnassignedMentions() const { return mUnassignedMentions; }
+    // Number of times a buffer grew since the workspace was created
+    size_t GetAllocationsNum() const { return mAllocations; }
+
+private:
+    template <typename> friend class BasicTextRanker;
+
+    // resize within the capacity, or grow (counted) to at least twice the old capacity
+    template <typename T>
+    void Fit(std::vector<T>& buffer, size_t size)
+    {
+        if (size > buffer.capacity()) {
+            mAllocations++;
+            buffer.reserve(std::max(size, 2 * buffer.capacity()));
+        }
+        buffer.resize(size);
+    }
+
+    std::vector<int> mParagraphIds;
+    std::vector<Interval> mPositions;
+    std::vector<uint32_t> mSpanOffsets;  // CSR by entity: the mentions after the mention policy
+    std::vector<std::pair<int, int>> mSpans;
+    IntervalArena mTree;
+    std::vector<std::pair<int, EntityIndex>> mAssignments;  // (paragraph, entity) of every assigned mention
+    std::vector<uint32_t> mMentionOffsets;  // CSR by paragraph: mentions, then (entity, count)
+    std::vector<uint32_t> mCursor;
+    std::vector<EntityIndex> mMentions;
+    std::vector<uint32_t> mCountOffsets;
+    std::vector<std::pair<EntityIndex, uint32_t>> mCounts;
+    std::vector<ParagraphView> mViews;
+    BasicSimilarityContext<std::vector<ParagraphView>> mSimilarity;
+    std::vector<Weight> mAdjacency;  // kDim x kDim, row major
+    std::vector<double> mOutWeight;  // out-weights while the graph is built
+    std::vector<Weight> mOutWeightSum;
+    std::vector<Weight> mScores, mNewScores;
+    std::vector<double> mContribution;
+    std::vector<std::pair<int, double>> mOrder;
+    KeyParagraphs mResult;
+    size_t mAllocations;
+    size_t mUnassignedMentions;
+};
+
+typedef BasicRankingWorkspace<double> RankingWorkspace;
+typedef BasicRankingWorkspace<float> CompactRankingWorkspace;
@@ -0,0 +1,160 @@
+#include "segmenter.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SEGMENTER_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+const char* const ParagraphSegmenter::kBlankLine = "blank_line";
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+static inline int LowestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+
+ParagraphSegmenter::ParagraphSegmenter(const std::vector<std::string>& separators, int minParagraphLen)
+	: mSeparators(separators), mBlankLines(false), mMinParagraphLen(minParagraphLen)
+{
+	for (const std::string& separator : separators) {
+		if (separator.empty()) {
+			throw std::invalid_argument("Empty paragraph separator");
+		}
+		char first;
+		if (separator == kBlankLine) {
+			mBlankLines = true;
+			first = '\n';
+		}
+		else {
+			mLiterals.push_back(separator);
+			first = separator[0];
+		}
+		if (mFirstBytes.find(first) == std::string::npos) {
+			mFirstBytes.push_back(first);
+		}
+	}
+	// longer literals first, so "\n\n\n" wins over "\n\n"
+	std::stable_sort(mLiterals.begin(), mLiterals.end(),
+		[](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+}
+
+size_t ParagraphSegmenter::MatchAt(const std::string& text, size_t pos) const
+{
+	for (const std::string& literal : mLiterals) {
+		if (text.compare(pos, literal.size(), literal) == 0) {
+			return literal.size();
+		}
+	}
+
+	if (mBlankLines && text[pos] == '\n') {
+		// skip whitespace-only lines, the separator ends after the last line break
+		size_t end = 0;
+		for (size_t i = pos + 1; i < text.size() && IsSpace(text[i]); i++) {
+			if (text[i] == '\n') {
+				end = i + 1;
+			}
+		}
+		if (end > 0) {
+			return end - pos;
+		}
+	}
+	return 0;
+}
+
+std::vector<std::pair<int, int>> ParagraphSegmenter::Segment(const std::string& text, SpanUnits units) const
+{
+	std::vector<std::pair<int, int>> paragraphs;
+	const char* data = text.data();
+	size_t size = text.size();
+
+	// code points are counted incrementally - cpBytes is the byte that cpCount was counted up to
+	size_t cpBytes = 0, cpCount = 0;
+	auto toUnits = [&](size_t byte) -> int {
+		if (units == SpanUnits::Bytes) {
+			return (int)byte;
+		}
+		cpCount += Utf8Index::CountCodePoints(data + cpBytes, byte - cpBytes);
+		cpBytes = byte;
+		return (int)cpCount;
+	};
+
+	size_t start = 0;  // start of the current paragraph
+	auto emit = [&](size_t end) {
+		size_t low = start, high = end;
+		while (low < high && IsSpace(data[low])) low++;
+		while (high > low && IsSpace(data[high - 1])) high--;
+		if (low == high) {
+			return;
+		}
+		int first = toUnits(low);
+		int last = toUnits(high);
+		if (last - first >= mMinParagraphLen) {
+			paragraphs.push_back({ first, last });
+		}
+	};
+
+	size_t pos = 0;
+	while (pos < size) {
+		size_t candidate = size;  // next position that starts with the first byte of a separator
+#ifdef SEGMENTER_SSE2
+		size_t i = pos;
+		for (; i + 16 <= size; i += 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			int mask = 0;
+			for (char c : mFirstBytes) {
+				mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+			}
+			if (mask != 0) {
+				candidate = i + LowestBit((unsigned int)mask);
+				break;
+			}
+		}
+		if (candidate == size) {
+			for (; i < size; i++) {
+				if (mFirstBytes.find(data[i]) != std::string::npos) {
+					candidate = i;
+					break;
+				}
+			}
+		}
+#else
+		for (size_t i = pos; i < size; i++) {
+			if (mFirstBytes.find(data[i]) != std::string::npos) {
+				candidate = i;
+				break;
+			}
+		}
+#endif
+		if (candidate == size) {
+			break;
+		}
+
+		size_t length = MatchAt(text, candidate);
+		if (length == 0) {
+			pos = candidate + 1;
+			continue;
+		}
+		emit(candidate);
+		start = pos = candidate + length;
+	}
+	emit(size);
+
+	return paragraphs;
+}
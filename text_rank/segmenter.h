@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include "utf8_index.h"
+
+// Native paragraph segmentation, so python does not have to walk the text before ranking.
+// The text is scanned 16 bytes at a time (SSE2 when available) for the first byte of any separator,
+// and only those positions are checked for a full match. Paragraphs are trimmed of surrounding
+// whitespace, and the ones shorter than minParagraphLen characters are dropped in the same pass.
+class ParagraphSegmenter
+{
+public:
+	// "blank_line" is a line break, any number of whitespace-only lines and another line break.
+	// Every other separator is matched literally (e.g. "###PARA###").
+	static const char* const kBlankLine;
+
+	explicit ParagraphSegmenter(const std::vector<std::string>& separators = std::vector<std::string>(1, kBlankLine), int minParagraphLen = 40);
+
+	// (start, end) of every paragraph, in code points (python str indices) or bytes
+	std::vector<std::pair<int, int>> Segment(const std::string& text, SpanUnits units = SpanUnits::CodePoints) const;
+
+	const std::vector<std::string>& GetSeparators() const { return mSeparators; }
+	int GetMinParagraphLen() const { return mMinParagraphLen; }
+
+private:
+	size_t MatchAt(const std::string& text, size_t pos) const;  // length of the separator that starts at pos, 0 if none
+
+	std::vector<std::string> mSeparators;
+	std::vector<std::string> mLiterals;  // the separators that are matched literally
+	bool mBlankLines;
+	std::string mFirstBytes;  // distinct first bytes of all separators ('\n' for blank lines)
+	int mMinParagraphLen;
+};
@@ -1,8 +1,21 @@
 # -*- coding: utf-8 -*-
 
 from setuptools import setup, Extension
+from setuptools.command.build_ext import build_ext
 import pybind11
 import os
+import subprocess
+import sys
+
+
+class build_ext_checked(build_ext):
+    # pybind11 reports some binding errors (e.g. a default argument of a class that is not bound yet)
+    # only when the module is imported, so the built module is imported once
+    def run(self):
+        build_ext.run(self)
+        for ext in self.extensions:
+            module_dir = os.path.dirname(os.path.abspath(self.get_ext_fullpath(ext.name)))
+            subprocess.check_call([sys.executable, '-c', 'import ' + ext.name], cwd=module_dir)
 
 ext_modules = [
     Extension(
@@ -10,10 +23,20 @@ ext_modules = [
         sources=[
             "bindings.cpp",
             'text_ranker.cpp',
-            'Paragraph.cpp',
-            'IntervalTree.cpp',
-            'IntervalTreeWrapper.cpp'
-        ],
+            'IntervalTreeWrapper.cpp',
+            'similarity.cpp',
+            'monte_carlo.cpp',
+            'utf8_index.cpp',
+            'segmenter.cpp',
+            'chapter_detector.cpp',
+            'ranking_workspace.cpp',
+            'local_push.cpp',
+            'mention_normalizer.cpp'
+        ] + ([] if os.name == 'nt' else [
+            # client of the ranking daemon (Unix domain sockets)
+            'ranking_client.cpp',
+            'ranking_protocol.cpp'
+        ]),
         include_dirs=[
             pybind11.get_include(),
             'C:\\Users\\user\\Documents\\year2\\project\\TextRank\\TextRank', 
@@ -25,4 +48,5 @@ setup(
     name='textranker',
     version='0.1',
     ext_modules=ext_modules,
+    cmdclass={'build_ext': build_ext_checked},
 )
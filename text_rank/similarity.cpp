@@ -0,0 +1,16 @@
+#include "similarity.h"
+#include <stdexcept>
+
+
+SimilarityKind SimilarityKindFromName(const std::string& name)
+{
+    if (name == "log_overlap")
+        return SimilarityKind::LogOverlap;
+    if (name == "jaccard")
+        return SimilarityKind::Jaccard;
+    if (name == "cosine")
+        return SimilarityKind::Cosine;
+    if (name == "idf_overlap")
+        return SimilarityKind::IdfOverlap;
+    throw std::invalid_argument("Unknown similarity policy: " + name);
+}
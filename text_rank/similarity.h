@@ -0,0 +1,187 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cmath>
+#include "Paragraph.h"
+
+// Similarity policies for the paragraph graph.
+// TextRanker::BuildGraph is templated on one of these, so the n^2 loop calls
+// Compute directly and the compiler can inline it - no runtime branch or virtual call.
+// Each policy has:
+//   static void Prepare(Context& ctx);  // once per graph, before the pair loop
+//   static double Compute(const Context& ctx, size_t a, size_t b);
+// Context is a BasicSimilarityContext over anything that looks like a vector of paragraphs
+// (GetCharsNum() and a sorted GetMentionCounts()), so the workspace ranking can use them on its flat views.
+
+
+enum class SimilarityKind {
+    LogOverlap,  // common entities / (log(mentions a) + log(mentions b)) - the original formula
+    Jaccard,     // common entities / union of entities
+    Cosine,      // cosine over the per-entity mention counts
+    IdfOverlap   // idf weighted jaccard, entities that appear everywhere count less
+};
+
+// Parse the name used by the python side ("log_overlap", "jaccard", "cosine", "idf_overlap").
+// Throws std::invalid_argument for an unknown name.
+SimilarityKind SimilarityKindFromName(const std::string& name);
+
+
+// The buffers keep their capacity, so a context that is kept between graphs does not allocate
+template <typename Paragraphs>
+struct BasicSimilarityContext {
+    explicit BasicSimilarityContext(const Paragraphs& paragraphs)
+        : paragraphs(paragraphs) { }
+
+    const Paragraphs& paragraphs;
+    std::vector<double> paragraphNorm;  // filled by policies that need it (cosine)
+    std::vector<double> entityWeight;   // filled by policies that need it (idf)
+    std::vector<size_t> documentFrequency;  // idf scratch
+};
+
+// Walk the common entities of two paragraphs (both lists are sorted by entity id).
+template <typename P, typename Fn>
+inline void ForEachCommonEntity(const P& a, const P& b, Fn fn)
+{
+    const auto& ea = a.GetMentionCounts();
+    const auto& eb = b.GetMentionCounts();
+    size_t i = 0, j = 0;
+    while (i < ea.size() && j < eb.size()) {
+        if (ea[i].first < eb[j].first) {
+            i++;
+        }
+        else if (eb[j].first < ea[i].first) {
+            j++;
+        }
+        else {
+            fn(ea[i].first, ea[i].second, eb[j].second);
+            i++;
+            j++;
+        }
+    }
+}
+
+
+struct LogOverlapSimilarity {
+    template <typename Context>
+    static void Prepare(Context&) { }
+
+    template <typename Context>
+    static double Compute(const Context& ctx, size_t a, size_t b)
+    {
+        const auto& pa = ctx.paragraphs[a];
+        const auto& pb = ctx.paragraphs[b];
+        // if a or b does not contains entities
+        if (pa.GetCharsNum() == 0 || pb.GetCharsNum() == 0) {
+            return 0.0;
+        }
+
+        size_t common = 0;
+        ForEachCommonEntity(pa, pb, [&common](EntityIndex, uint32_t, uint32_t) { common++; });
+
+        double denominator = std::log(static_cast<double>(pa.GetCharsNum())) + std::log(static_cast<double>(pb.GetCharsNum()));
+        if (std::fabs(denominator) < 1e-6) {
+            return 0.0;
+        }
+        return 1.0 * common / denominator;
+    }
+};
+
+
+struct JaccardSimilarity {
+    template <typename Context>
+    static void Prepare(Context&) { }
+
+    template <typename Context>
+    static double Compute(const Context& ctx, size_t a, size_t b)
+    {
+        const auto& pa = ctx.paragraphs[a];
+        const auto& pb = ctx.paragraphs[b];
+        size_t common = 0;
+        ForEachCommonEntity(pa, pb, [&common](EntityIndex, uint32_t, uint32_t) { common++; });
+
+        size_t unionSize = pa.GetMentionCounts().size() + pb.GetMentionCounts().size() - common;
+        if (unionSize == 0) {
+            return 0.0;
+        }
+        return 1.0 * common / unionSize;
+    }
+};
+
+
+struct CosineSimilarity {
+    template <typename Context>
+    static void Prepare(Context& ctx)
+    {
+        ctx.paragraphNorm.assign(ctx.paragraphs.size(), 0.0);
+        for (size_t i = 0; i < ctx.paragraphs.size(); i++) {
+            double sum = 0.0;
+            for (const auto& e : ctx.paragraphs[i].GetMentionCounts()) {
+                sum += static_cast<double>(e.second) * e.second;
+            }
+            ctx.paragraphNorm[i] = std::sqrt(sum);
+        }
+    }
+
+    template <typename Context>
+    static double Compute(const Context& ctx, size_t a, size_t b)
+    {
+        double denominator = ctx.paragraphNorm[a] * ctx.paragraphNorm[b];
+        if (denominator < 1e-12) {
+            return 0.0;
+        }
+        double dot = 0.0;
+        ForEachCommonEntity(ctx.paragraphs[a], ctx.paragraphs[b],
+            [&dot](EntityIndex, uint32_t ca, uint32_t cb) { dot += static_cast<double>(ca) * cb; });
+        return dot / denominator;
+    }
+};
+
+
+struct IdfOverlapSimilarity {
+    template <typename Context>
+    static void Prepare(Context& ctx)
+    {
+        // document frequency of every entity over the paragraphs of the graph
+        std::vector<size_t>& df = ctx.documentFrequency;
+        df.clear();
+        for (const auto& p : ctx.paragraphs) {
+            for (const auto& e : p.GetMentionCounts()) {
+                if (e.first >= df.size()) {
+                    df.resize(e.first + 1, 0);
+                }
+                df[e.first]++;
+            }
+        }
+
+        double n = static_cast<double>(ctx.paragraphs.size());
+        ctx.entityWeight.assign(df.size(), 0.0);
+        for (size_t e = 0; e < df.size(); e++) {
+            if (df[e] > 0) {
+                ctx.entityWeight[e] = std::log(1.0 + n / df[e]);
+            }
+        }
+
+        // total weight of each paragraph, so Compute only has to walk the intersection
+        ctx.paragraphNorm.assign(ctx.paragraphs.size(), 0.0);
+        for (size_t i = 0; i < ctx.paragraphs.size(); i++) {
+            for (const auto& e : ctx.paragraphs[i].GetMentionCounts()) {
+                ctx.paragraphNorm[i] += ctx.entityWeight[e.first];
+            }
+        }
+    }
+
+    template <typename Context>
+    static double Compute(const Context& ctx, size_t a, size_t b)
+    {
+        double common = 0.0;
+        const double* weight = ctx.entityWeight.data();
+        ForEachCommonEntity(ctx.paragraphs[a], ctx.paragraphs[b],
+            [&common, weight](EntityIndex e, uint32_t, uint32_t) { common += weight[e]; });
+
+        double unionWeight = ctx.paragraphNorm[a] + ctx.paragraphNorm[b] - common;
+        if (unionWeight < 1e-12) {
+            return 0.0;
+        }
+        return common / unionWeight;
+    }
+};
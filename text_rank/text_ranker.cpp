@@ -1,195 +1,982 @@
 #include "text_ranker.h"
 #include "IntervalTree.h"
+#include "monte_carlo.h"
+#include "parallel.h"
 #include <iostream>
 #include <string>
 #include <cmath>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
 
 
 // קמפול:
 //  C:\Users\user\Documents\year2\project\TextRank\TextRank>C:\Users\user\AppData\Local\Programs\Python\Python312\python.exe setup.py build_ext --inplace
 
-static std::vector<Paragraph> BuildParagraphs(const std::string& str, const std::vector<std::pair<int, int>> para) {
-	std::vector<Paragraph> tokens;
-	for (size_t i = 0; i < para.size(); i++) {
-		Interval intr;
-		intr.low = para[i].first;
-		intr.high = para[i].second;
-		tokens.push_back(Paragraph(intr));
-	}
-	return tokens;
-}
-
 
 static bool PairComp(std::pair<int, double> a, std::pair<int, double> b) 
 {
-    return a.second > b.second;
+    // equal scores (e.g. paragraphs without entities) are ordered by position, so the top-K does not depend on the sort
+    if (a.second != b.second)
+        return a.second > b.second;
+    return a.first < b.first;
     //return a.second < b.second;
 }
 
-std::map<int, std::set<size_t>> TextRanker::ExtractKeyParagraphs(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK)
+// Workspace of the calling thread, for the const calls that python runs without the GIL. It keeps the buffers of
+// the largest chapter the thread has ranked, like the workspace of a ranker does.
+template <typename Weight>
+static BasicRankingWorkspace<Weight>& ThreadWorkspace()
 {
+    static thread_local BasicRankingWorkspace<Weight> workspace;
+    return workspace;
+}
 
-    std::map<int, std::set<size_t>> outputs;
+// Deadline and work budget of ExtractKeyParagraphsAnytime. Allows is called before every graph row and iteration with
+// its cost, and says no when the step would pass maxWork, or is expected to pass the deadline at the speed of the
+// current stage so far (time per unit of work since BeginStage). The first iteration has no speed of its own yet and is
+// predicted at the speed of the graph - a pair costs more than a multiply-add, so the guess errs on the early side.
+// Once a step was refused the budget stays exhausted, nothing later runs.
+struct WorkBudget {
+    explicit WorkBudget(const AnytimeOptions& options)
+        : start(std::chrono::steady_clock::now()), deadlineMs(options.deadlineMs), maxWork(options.maxWork),
+          work(0.0), exhausted(false), iterations(0), residual(std::numeric_limits<double>::infinity()), converged(false),
+          stageStart(start), stageWork(0.0), msPerUnit(0.0) { }
 
-    //outputs.clear();
-    if(input.empty() || topK < 1) {
-        return outputs;
+    bool Allows(double cost) {
+        if (exhausted) {
+            return false;
+        }
+        if (maxWork > 0 && work + cost > maxWork) {
+            exhausted = true;
+        }
+        else if (deadlineMs > 0) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (stageWork > 0) {
+                msPerUnit = std::chrono::duration<double, std::milli>(now - stageStart).count() / stageWork;
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(now - start).count();
+            exhausted = elapsed + msPerUnit * cost > deadlineMs;
+        }
+        return !exhausted;
     }
+    void Spend(double cost) { work += cost; stageWork += cost; }
+    // the speed of the new stage is measured from here, until then the last one is used
+    void BeginStage() { stageStart = std::chrono::steady_clock::now(); stageWork = 0.0; }
 
-    
-    for (size_t i = 0; i < entities.size(); i++)
-    {
-        std::vector<Interval> entity;
-        for (size_t j = 0; j < entities[i].size(); j++)
-        {
-            entity.push_back({ entities[i][j].first, entities[i][j].second });
+    std::chrono::steady_clock::time_point start;
+    double deadlineMs, maxWork;
+    double work;
+    bool exhausted;
+    int iterations;   // reported by Iterate
+    double residual;
+    bool converged;
+    std::chrono::steady_clock::time_point stageStart;
+    double stageWork;
+    double msPerUnit;
+};
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::ExtractKeyParagraphs(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK, const std::string& similarity)
+{
+    // the workspace path on the ranker's own workspace, with the usual map result
+    return ExtractKeyParagraphsInto(input, paragraphs, entities, topK, mWorkspace, SimilarityKindFromName(similarity)).ToMap();
+}
+
+template <typename Weight>
+BasicRankingResult<Weight> BasicTextRanker<Weight>::ExtractKeyParagraphsWithGraph(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK, const std::string& similarity) const
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    BasicRankingResult<Weight> result;
+    if (input.empty() || topK < 1) {
+        return result;
+    }
+    // the workspace of the thread, so the call does not touch the ranker (python runs it without the GIL)
+    Workspace& ws = ThreadWorkspace<Weight>();
+    if (!PrepareGraph(input, paragraphs, entities, similarityKind, ws) || !CalcParagraphScores(ws)) {
+        return result;
+    }
+    SelectKeyParagraphs(topK, ws);
+    result.keyParagraphs = ws.mResult.ToMap();
+    result.paragraphIds = ws.mParagraphIds;
+
+    // the links are counted first, both index arrays get the dtype the count needs
+    int kDim = ws.mViews.size();
+    size_t links = 0;
+    for (size_t k = 0; k < (size_t)kDim * kDim; k++) {
+        links += ws.mAdjacency[k] != 0;
+    }
+    auto fill = [&](auto& offsets, auto& targets) {
+        typedef typename std::decay<decltype(offsets)>::type::value_type Index;
+        offsets.reserve(kDim + 1);
+        targets.reserve(links);
+        result.weights.reserve(links);
+        offsets.push_back(0);
+        for (int i = 0; i < kDim; i++) {
+            const Weight* row = ws.mAdjacency.data() + (size_t)i * kDim;
+            for (int j = 0; j < kDim; j++) {
+                if (row[j] != 0) {
+                    targets.push_back((Index)j);
+                    result.weights.push_back(row[j]);
+                }
+            }
+            offsets.push_back((Index)targets.size());
         }
-        this->mEntities.push_back(entity);
-		//entity.clear();
+    };
+    if (links < ((size_t)1 << 31)) {
+        fill(result.offsets, result.targets);
+    }
+    else {
+        fill(result.offsets64, result.targets64);
     }
+    result.outWeights = ws.mOutWeightSum;
+    result.scores = ws.mScores;
+    return result;
+}
 
-    // TextRank
-    bool ret = true;
-    ret &= ExtractParagraphs(input, paragraphs, this->mParagraphs);
-    ret &= BuildGraph(this->mParagraphs, this->mEntities);
-    ret &= CalcParagraphScores();
+template <typename Weight>
+AnytimeRanking BasicTextRanker<Weight>::ExtractKeyParagraphsAnytime(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK, const AnytimeOptions& options, const std::string& similarity) const
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    AnytimeRanking ranking;
+    if (input.empty() || topK < 1) {
+        return ranking;
+    }
 
+    // the workspace of the thread, so the call does not touch the ranker (python runs it without the GIL)
+    Workspace& ws = ThreadWorkspace<Weight>();
+    WorkBudget budget(options);
+    bool ret = PrepareGraph(input, paragraphs, entities, similarityKind, ws, &budget);
+    ranking.graphComplete = !budget.exhausted;
+    ret = ret && CalcParagraphScores(ws, std::vector<double>(), &budget);
     if (!ret) {
+        return ranking;
+    }
+
+    SelectKeyParagraphs(topK, ws);
+    ranking.keyParagraphs = ws.mResult.ToMap();
+    ranking.complete = !budget.exhausted;
+    ranking.iterations = budget.iterations;
+    ranking.residual = budget.residual;
+    ranking.converged = budget.converged;
+    ranking.work = budget.work;
+    return ranking;
+}
+
+template <typename Weight>
+std::pair<std::map<int, std::set<EntityIndex>>, std::vector<std::pair<EntityIndex, double>>> BasicTextRanker<Weight>::ExtractKeyParagraphsAndEntities(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK, int topEntities, const std::string& similarity)
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    std::pair<std::map<int, std::set<EntityIndex>>, std::vector<std::pair<EntityIndex, double>>> outputs;
+    if (input.empty() || topK < 1) {
+        return outputs;
+    }
+    if (!PrepareGraph(input, paragraphs, entities, similarityKind, mWorkspace) || !CalcParagraphScores(mWorkspace)) {
+        return outputs;
+    }
+
+    SelectKeyParagraphs(topK, mWorkspace);
+    outputs.first = mWorkspace.mResult.ToMap();
+    outputs.second = RankEntities(topEntities, mWorkspace);
+    return outputs;
+}
+
+template <typename Weight>
+const KeyParagraphs& BasicTextRanker<Weight>::ExtractKeyParagraphsInto(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, BasicRankingWorkspace<Weight>& ws, SimilarityKind similarity) const
+{
+    KeyParagraphs& result = ws.mResult;
+    result.paragraphs.clear();
+    result.entityOffsets.clear();
+    result.entities.clear();
+    if (input.empty() || topK < 1) {
+        return result;
+    }
+
+    // TextRank
+    if (PrepareGraph(input, paragraphs, entities, similarity, ws) && CalcParagraphScores(ws)) {
+        SelectKeyParagraphs(topK, ws);
+    }
+    return result;
+}
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::ExtractKeyParagraphsApprox(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, int topK, const MonteCarloOptions& options, const std::string& similarity)
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    std::map<int, std::set<EntityIndex>> outputs;
+    if (input.empty() || topK < 1) {
         return outputs;
     }
+    // the whole book - only the cap of the options, and no dense matrix
+    Workspace& ws = mWorkspace;
+    ws.mUnassignedMentions = 0;
+    if (!ExtractParagraphs(input, paragraphs, options.maxParagraphs, ws)) {
+        return outputs;
+    }
+    AssignMentions(entities, ws);
+    NeighbourLists graph;
+    BuildNeighbourLists(entities.size(), similarityKind, graph, ws);
 
-    // Return the sentences with the highest score
-    int kDim = mParagraphs.size();
-    std::vector< std::pair<int, double> > visitPairs;  // (id, score)
-    for(int i=0; i<kDim; ++i) {
-        visitPairs.push_back(std::pair<int, double>(i, mScores[i]));
+    // the walks restart with the same teleport + position bonus that CalcParagraphScores adds every iteration
+    int kDim = ws.mViews.size();
+    std::vector<double> restart(kDim);
+    for (int i = 0; i < kDim; i++) {
+        restart[i] = 1.0 - m_d + this->ParagraphScoreByPosition(i, kDim);
     }
+    EstimateScoresMonteCarlo(graph, restart, m_d, topK, options, ws.mScores);
 
-	//quickSort(visitPairs, 0, visitPairs.size() - 1, PairComp); // Sort the pairs based on the score
-    std::sort(visitPairs.begin(), visitPairs.end(), PairComp);
+    SelectKeyParagraphs(topK, ws);
+    return ws.mResult.ToMap();
+}
 
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::ExtractKeyParagraphsBudget(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, const BudgetOptions& options, const std::string& similarity)
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+    // with lambda 0 every gain is a penalty, and above 1 the redundancy becomes a bonus
+    if (!(options.lambda > 0 && options.lambda <= 1)) {
+        throw std::invalid_argument("lambda must be in (0, 1]");
+    }
 
-    for(int i=0; i<topK && i<kDim; ++i) {
+    std::map<int, std::set<EntityIndex>> outputs;
+    if (input.empty() || options.budget <= 0) {
+        return outputs;
+    }
+    if (!PrepareGraph(input, paragraphs, entities, similarityKind, mWorkspace) || !CalcParagraphScores(mWorkspace)) {
+        return outputs;
+    }
+
+    return SelectWithinBudget(options, mWorkspace);
+}
+
+// Paragraphs of every entity with its mentions in them, the restart of a personalized ranking
+static std::vector<std::vector<std::pair<uint32_t, double>>> ParagraphsByEntity(const std::vector<ParagraphView>& paragraphs)
+{
+    std::vector<std::vector<std::pair<uint32_t, double>>> byEntity;
+    for (size_t i = 0; i < paragraphs.size(); i++) {
+        for (const auto& e : paragraphs[i].GetMentionCounts()) {
+            if (e.first >= byEntity.size()) {
+                byEntity.resize(e.first + 1);
+            }
+            byEntity[e.first].push_back({ (uint32_t)i, (double)e.second });
+        }
+    }
+    return byEntity;
+}
+
+// The entities of a paragraph, as the map results have them
+static std::set<EntityIndex> EntitySet(const ParagraphView& paragraph)
+{
+    std::set<EntityIndex> entities;
+    for (const auto& e : paragraph.GetMentionCounts()) {
+        entities.insert(entities.end(), e.first);
+    }
+    return entities;
+}
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::ExtractKeyParagraphsFor(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, const std::vector<EntityIndex>& seeds, int topK, double epsilon, const std::string& similarity)
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    std::map<int, std::set<EntityIndex>> outputs;
+    if (input.empty() || topK < 1 || seeds.empty()) {
+        return outputs;
+    }
+    Workspace& ws = mWorkspace;
+    if (!PrepareGraph(input, paragraphs, entities, similarityKind, ws)) {
+        return outputs;
+    }
+
+    auto byEntity = ParagraphsByEntity(ws.mViews);
+    std::vector<std::pair<uint32_t, double>> restart;
+    for (EntityIndex seed : seeds) {
+        if (seed < byEntity.size()) {
+            restart.insert(restart.end(), byEntity[seed].begin(), byEntity[seed].end());
+        }
+    }
+
+    NeighbourLists graph;
+    graph.Build(ws.mAdjacency, ws.mOutWeightSum);
+    PushState state;
+    return SelectPersonalized(graph, restart, topK, epsilon, state, ws);
+}
+
+template <typename Weight>
+std::map<EntityIndex, std::map<int, std::set<EntityIndex>>> BasicTextRanker<Weight>::ExtractKeyParagraphsPerEntity(const std::string& input, std::vector< std::pair<int, int>> paragraphs, std::vector<std::vector<std::pair<int, int>>> entities, std::vector<EntityIndex> characters, int topK, double epsilon, int threads, const std::string& similarity) const
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    std::map<EntityIndex, std::map<int, std::set<EntityIndex>>> outputs;
+    if (input.empty() || topK < 1) {
+        return outputs;
+    }
+    // the workspace of the thread, so the call does not touch the ranker (python runs it without the GIL)
+    Workspace& ws = ThreadWorkspace<Weight>();
+    if (!PrepareGraph(input, paragraphs, entities, similarityKind, ws)) {
+        return outputs;
+    }
+
+    auto byEntity = ParagraphsByEntity(ws.mViews);
+    if (characters.empty()) {
+        for (size_t e = 0; e < byEntity.size(); e++) {
+            if (!byEntity[e].empty()) {
+                characters.push_back((EntityIndex)e);
+            }
+        }
+    }
+
+    NeighbourLists graph;
+    graph.Build(ws.mAdjacency, ws.mOutWeightSum);
+
+    // every thread keeps its push buffers, the results are written to their own slot
+    if (threads <= 0) {
+        threads = DefaultThreadsNum();
+    }
+    std::vector<PushState> states(threads);
+    std::vector<std::map<int, std::set<EntityIndex>>> results(characters.size());
+    static const std::vector<std::pair<uint32_t, double>> noParagraphs;
+    ParallelForEach(characters.size(), threads, [&](size_t c, int t) {
+        EntityIndex character = characters[c];
+        const auto& restart = character < byEntity.size() ? byEntity[character] : noParagraphs;
+        results[c] = SelectPersonalized(graph, restart, topK, epsilon, states[t], ws);
+    });
+
+    for (size_t c = 0; c < characters.size(); c++) {
+        outputs[characters[c]] = std::move(results[c]);
+    }
+    return outputs;
+}
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::SelectPersonalized(const NeighbourLists& graph, const std::vector<std::pair<uint32_t, double>>& restart, int topK, double epsilon, PushState& state, const Workspace& ws) const
+{
+    std::map<int, std::set<EntityIndex>> outputs;
+    ForwardPush(graph, restart, 1.0 - m_d, epsilon, state);
+
+    // only the touched paragraphs can have a score, they are ordered like SelectKeyParagraphs
+    std::vector<std::pair<int, double>> visitPairs;
+    visitPairs.reserve(state.touched.size());
+    for (uint32_t i : state.touched) {
+        if (state.estimate[i] > 0) {
+            visitPairs.push_back({ (int)i, state.estimate[i] });
+        }
+    }
+    size_t selected = std::min(visitPairs.size(), (size_t)topK);
+    std::partial_sort(visitPairs.begin(), visitPairs.begin() + selected, visitPairs.end(), PairComp);
+    for (size_t i = 0; i < selected; i++) {
         int id = visitPairs[i].first;
-        outputs[id] = this->mParagraphs[id].GetEntities();
+        outputs[id] = EntitySet(ws.mViews[id]);
     }
+    return outputs;
+}
+
+// Jaccard overlap of the entity sets of two paragraphs (the counts are sorted by entity), 0 if both have none.
+// The redundancy of the budget mode - unlike the graph edge it does not depend on the similarity policy, so two
+// paragraphs about the same entities are redundant also where a policy gives them a weak edge (log_overlap, one mention each).
+static double EntityOverlap(const ParagraphView& a, const ParagraphView& b)
+{
+    const MentionSpan& x = a.GetMentionCounts();
+    const MentionSpan& y = b.GetMentionCounts();
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < x.size() && j < y.size();) {
+        if (x[i].first < y[j].first) {
+            i++;
+        }
+        else if (y[j].first < x[i].first) {
+            j++;
+        }
+        else {
+            common++;
+            i++;
+            j++;
+        }
+    }
+    size_t all = x.size() + y.size() - common;
+    return all == 0 ? 0.0 : (double)common / all;
+}
 
+// index of the span that contains position, spans sorted by start (-1 if none)
+static int FindSpan(const std::vector<std::pair<int, int>>& spans, const std::vector<int>& order, int position)
+{
+    auto it = std::upper_bound(order.begin(), order.end(), position,
+        [&spans](int pos, int id) { return pos < spans[id].first; });
+    if (it == order.begin()) {
+        return -1;
+    }
+    int id = *(it - 1);
+    return position < spans[id].second ? id : -1;
+}
+
+template <typename Weight>
+StoryRanking BasicTextRanker<Weight>::RankStory(const std::string& input, const std::vector<std::pair<int, int>>& chapters, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<std::vector<std::pair<int, int>>>& entities, double keyRatio, double priorWeight, int threads, const std::string& similarity) const
+{
+    SimilarityKind similarityKind = SimilarityKindFromName(similarity);
+
+    StoryRanking ranking;
+    if (input.empty() || chapters.empty()) {
+        return ranking;
+    }
+    int chaptersNum = chapters.size();
+
+    // the mentions are normalized once for the story, so the chapters do not have to do it again
+    std::vector<std::vector<std::pair<int, int>>> normalized;
+    if (mMentionPolicy != MentionPolicy::Keep) {
+        normalized = entities;
+        NormalizeMentions(normalized, mMentionPolicy, threads);
+    }
+    const std::vector<std::vector<std::pair<int, int>>>& storyEntities = mMentionPolicy != MentionPolicy::Keep ? normalized : entities;
+
+    // Level 1 - the chapters are the nodes, the entity mentions are aggregated per chapter by the same
+    // assignment pass, so the chapter graph is the paragraph graph one level up. It is ranked by a ranker of its
+    // own - every chapter is a node (no maxParagraphs) and the mentions are already normalized.
+    BasicTextRanker<Weight> chapterRanker(m_d, mMaxIter, mTol);
+    chapterRanker.SetMaxParagraphs(0);
+    Workspace& ws = chapterRanker.mWorkspace;
+    if (!chapterRanker.PrepareGraph(input, chapters, storyEntities, similarityKind, ws) || !chapterRanker.CalcParagraphScores(ws)) {
+        return ranking;
+    }
+
+    for (size_t i = 0; i < ws.mViews.size(); i++) {
+        ranking.chapters.push_back({ ws.mParagraphIds[i], (double)ws.mScores[i] });
+    }
+    std::sort(ranking.chapters.begin(), ranking.chapters.end(), PairComp);
+
+    // global importance of an entity - its mentions weighted by the score of the chapter they are in
+    ranking.entityImportance.assign(storyEntities.size(), 0.0);
+    double maxImportance = 0.0;
+    for (size_t i = 0; i < ws.mViews.size(); i++) {
+        for (const auto& e : ws.mViews[i].GetMentionCounts()) {
+            ranking.entityImportance[e.first] += ws.mScores[i] * e.second;
+        }
+    }
+    for (double importance : ranking.entityImportance) {
+        maxImportance = std::max(maxImportance, importance);
+    }
+    if (maxImportance > 0.0) {
+        for (double& importance : ranking.entityImportance) {
+            importance /= maxImportance;
+        }
+    }
+
+    // Level 2 - split the paragraphs and the mentions by chapter (entity ids stay the same in every chapter)
+    std::vector<int> order(chaptersNum);
+    for (int c = 0; c < chaptersNum; c++) {
+        order[c] = c;
+    }
+    std::sort(order.begin(), order.end(), [&chapters](int a, int b) { return chapters[a].first < chapters[b].first; });
+
+    std::vector<std::vector<std::pair<int, int>>> chapterParagraphs(chaptersNum);
+    std::vector<std::vector<int>> chapterParagraphIds(chaptersNum);
+    for (size_t p = 0; p < paragraphs.size(); p++) {
+        int c = FindSpan(chapters, order, paragraphs[p].first);
+        if (c >= 0) {
+            chapterParagraphs[c].push_back(paragraphs[p]);
+            chapterParagraphIds[c].push_back((int)p);
+        }
+    }
+    std::vector<std::vector<std::vector<std::pair<int, int>>>> chapterEntities(chaptersNum, std::vector<std::vector<std::pair<int, int>>>(storyEntities.size()));
+    for (size_t e = 0; e < storyEntities.size(); e++) {
+        for (const auto& mention : storyEntities[e]) {
+            int c = FindSpan(chapters, order, mention.first);
+            if (c >= 0) {
+                chapterEntities[c][e].push_back(mention);
+            }
+        }
+    }
+
+    // every thread ranks its chapters with its own ranker (the rankers keep per call state)
+    ranking.keyParagraphs.resize(chaptersNum);
+    ParallelForEach(chaptersNum, threads, [&](size_t c, int) {
+        if (chapterParagraphs[c].empty()) {
+            return;
+        }
+        BasicTextRanker<Weight> worker(m_d, mMaxIter, mTol);
+        worker.SetMaxParagraphs(mMaxParagraphs);
+        ranking.keyParagraphs[c] = worker.RankChapter(input, chapterParagraphs[c], chapterParagraphIds[c], chapterEntities[c],
+            keyRatio, ranking.entityImportance, priorWeight, similarityKind);
+    });
+
+    return ranking;
+}
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::RankChapter(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<int>& paragraphIds, const std::vector<std::vector<std::pair<int, int>>>& entities, double keyRatio, const std::vector<double>& entityImportance, double priorWeight, SimilarityKind similarity)
+{
+    std::map<int, std::set<EntityIndex>> outputs;
+    Workspace& ws = mWorkspace;
+    if (!PrepareGraph(input, paragraphs, entities, similarity, ws)) {
+        return outputs;
+    }
+
+    // restart of every paragraph - (1 - priorWeight) uniform + priorWeight by the importance of its entities, mean 1
+    int kDim = ws.mViews.size();
+    std::vector<double> teleport(kDim, 0.0);
+    double sum = 0.0;
+    for (int i = 0; i < kDim; i++) {
+        for (const auto& e : ws.mViews[i].GetMentionCounts()) {
+            teleport[i] += entityImportance[e.first];
+        }
+        sum += teleport[i];
+    }
+    for (int i = 0; i < kDim; i++) {
+        double prior = sum > 0.0 ? teleport[i] * kDim / sum : 1.0;
+        teleport[i] = (1.0 - priorWeight) + priorWeight * prior;
+    }
+    if (!CalcParagraphScores(ws, teleport)) {
+        return outputs;
+    }
+
+    int topK = std::max(1, (int)std::ceil(keyRatio * kDim));
+    SelectKeyParagraphs(topK, ws);
+    for (auto& kp : ws.mResult.ToMap()) {
+        outputs[paragraphIds[ws.mParagraphIds[kp.first]]] = std::move(kp.second);
+    }
     return outputs;
 }
 
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::ExtractKeyParagraphsUtf8(const std::string& input, const std::vector< std::pair<int, int>>& paragraphs, const std::string& paragraphUnits, const std::vector<std::vector<std::pair<int, int>>>& entities, const std::string& entityUnits, int topK, const std::string& similarity)
+{
+    bool paragraphBytes = SpanUnitsFromName(paragraphUnits) == SpanUnits::Bytes;
+    bool entityBytes = SpanUnitsFromName(entityUnits) == SpanUnits::Bytes;
+
+    if (!paragraphBytes && !entityBytes) {
+        return ExtractKeyParagraphs(input, paragraphs, entities, topK, similarity);
+    }
+
+    // byte spans are translated even when both kinds are bytes - the minimum paragraph length is in code points
+    Utf8Index index(input);
+    std::vector<std::vector<std::pair<int, int>>> entityCodePoints;
+    if (entityBytes) {
+        entityCodePoints.reserve(entities.size());
+        for (const auto& mentions : entities) {
+            entityCodePoints.push_back(index.ToCodePoints(mentions));
+        }
+    }
+    return ExtractKeyParagraphs(input, paragraphBytes ? index.ToCodePoints(paragraphs) : paragraphs,
+        entityBytes ? entityCodePoints : entities, topK, similarity);
+}
+
+template <typename Weight>
+std::pair<std::vector<std::pair<int, int>>, std::map<int, std::set<EntityIndex>>> BasicTextRanker<Weight>::ExtractKeyParagraphsSegmented(const std::string& input, const ParagraphSegmenter& segmenter, const std::vector<std::vector<std::pair<int, int>>>& entities, int topK, const std::string& similarity)
+{
+    std::pair<std::vector<std::pair<int, int>>, std::map<int, std::set<EntityIndex>>> outputs;
+    outputs.first = segmenter.Segment(input, SpanUnits::CodePoints);
+
+    // ExtractParagraphs may still drop paragraphs (its own minimum length, maxParagraphs), keys go back to the spans
+    for (auto& kp : ExtractKeyParagraphs(input, outputs.first, entities, topK, similarity)) {
+        outputs.second[mWorkspace.mParagraphIds[kp.first]] = std::move(kp.second);
+    }
+    return outputs;
+}
 
-bool TextRanker::ExtractParagraphs(const std::string& input,std::vector<std::pair<int, int>> paragraphs, std::vector<Paragraph>& outputs)
+template <typename Weight>
+bool BasicTextRanker<Weight>::PrepareGraph(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, const std::vector<std::vector<std::pair<int, int>>>& entities, SimilarityKind similarity, Workspace& ws, WorkBudget* budget) const
+{
+    ws.mUnassignedMentions = 0;
+    if (!ExtractParagraphs(input, paragraphs, mMaxParagraphs, ws)) {
+        return false;
+    }
+    AssignMentions(entities, ws);
+    BuildGraph(entities.size(), similarity, ws, budget);
+    return true;
+}
+
+// The top-K by score into the workspace result, in increasing order like the keys of the map
+template <typename Weight>
+void BasicTextRanker<Weight>::SelectKeyParagraphs(int topK, Workspace& ws) const
+{
+    KeyParagraphs& result = ws.mResult;
+    int kDim = ws.mViews.size();
+    ws.Fit(ws.mOrder, kDim);
+    for (int i = 0; i < kDim; i++) {
+        ws.mOrder[i] = { i, (double)ws.mScores[i] };
+    }
+    int selected = std::min(topK, kDim);
+    std::partial_sort(ws.mOrder.begin(), ws.mOrder.begin() + selected, ws.mOrder.end(), PairComp);
+    ws.Fit(result.paragraphs, selected);
+    for (int i = 0; i < selected; i++) {
+        result.paragraphs[i] = ws.mOrder[i].first;
+    }
+    std::sort(result.paragraphs.begin(), result.paragraphs.end());
+
+    size_t entitiesNum = 0;
+    for (int paragraph : result.paragraphs) {
+        entitiesNum += ws.mCountOffsets[paragraph + 1] - ws.mCountOffsets[paragraph];
+    }
+    ws.Fit(result.entityOffsets, selected + 1);
+    ws.Fit(result.entities, entitiesNum);
+    size_t offset = 0;
+    for (int i = 0; i < selected; i++) {
+        int paragraph = result.paragraphs[i];
+        result.entityOffsets[i] = (uint32_t)offset;
+        for (uint32_t c = ws.mCountOffsets[paragraph]; c < ws.mCountOffsets[paragraph + 1]; c++) {
+            result.entities[offset++] = ws.mCounts[c].first;
+        }
+    }
+    result.entityOffsets[selected] = (uint32_t)offset;
+}
+
+template <typename Weight>
+std::map<int, std::set<EntityIndex>> BasicTextRanker<Weight>::SelectWithinBudget(const BudgetOptions& options, const Workspace& ws) const
+{
+    std::map<int, std::set<EntityIndex>> outputs;
+    int kDim = ws.mViews.size();
+
+    // scores are scaled to 0-1 like the redundancy, so lambda means the same for every chapter
+    double maxScore = 0;
+    for (int i = 0; i < kDim; i++) {
+        maxScore = std::max(maxScore, (double)ws.mScores[i]);
+    }
+    if (maxScore <= 0) {
+        maxScore = 1.0;  // all scores are 0, only the redundancy and the cost order the paragraphs
+    }
+
+    double charsPerToken = options.charsPerToken > 0 ? options.charsPerToken : 1.0;
+    std::vector<double> cost(kDim), costScale(kDim);
+    for (int i = 0; i < kDim; i++) {
+        Interval position = ws.mPositions[i];
+        cost[i] = std::max(1.0, std::ceil((position.high - position.low) / charsPerToken));
+        costScale[i] = std::pow(cost[i], options.costExponent);
+    }
+
+    std::vector<double> redundancy(kDim, 0.0);  // highest entity overlap with a selected paragraph
+    std::vector<bool> candidate(kDim, true);
+    double remaining = options.budget;
+    while (true) {
+        int best = -1;
+        double bestGain = 0;
+        for (int i = 0; i < kDim; i++) {
+            if (!candidate[i]) {
+                continue;
+            }
+            if (cost[i] > remaining) {
+                candidate[i] = false;  // the budget only shrinks, it will not fit later either
+                continue;
+            }
+            double mmr = options.lambda * ws.mScores[i] / maxScore - (1.0 - options.lambda) * redundancy[i];
+            double gain = mmr / costScale[i];
+            if (best < 0 || gain > bestGain) {
+                best = i;
+                bestGain = gain;
+            }
+        }
+        // stop only when nothing fits - a redundant paragraph has a negative gain, so it is picked after the rest
+        if (best < 0) {
+            break;
+        }
+
+        outputs[best] = EntitySet(ws.mViews[best]);
+        candidate[best] = false;
+        remaining -= cost[best];
+        for (int i = 0; i < kDim; i++) {
+            if (candidate[i]) {
+                redundancy[i] = std::max(redundancy[i], EntityOverlap(ws.mViews[i], ws.mViews[best]));
+            }
+        }
+    }
+
+    return outputs;
+}
+
+
+template <typename Weight>
+bool BasicTextRanker<Weight>::ExtractParagraphs(const std::string& input, const std::vector<std::pair<int, int>>& paragraphs, int maxParagraphs, Workspace& ws) const
 {
-    outputs.clear();
     if (input.empty()) { 
         //outputs.push_back({ "", 0, 0 });
         return false; 
     }
 
-    static const int maxTextLen = 100000;  // Maximum number of entities (need to consider word separators, UTF encoding, etc.)
-    std::string tempInput;
-    if ((int)input.size() > maxTextLen) {
-        tempInput = input.substr(0, maxTextLen);  // Articles that are too long will be truncated
-    } else {
-        tempInput = input;
-    }
-
+    // The spans are offsets in the whole input and are used as they are - long inputs (books in the approximate
+    // mode, RankStory) are ranked whole, maxParagraphs is the only cap (0 - none)
 
-    // Paragraph segmentation
+    // Paragraph segmentation - native splitting is in ParagraphSegmenter (ExtractKeyParagraphsSegmented)
     static const int minParagraphLen = 40;   // Minimum number of entities in a sentence (need to consider word separators, UTF encoding, etc.)
-    std::vector<Paragraph> tempOutput = BuildParagraphs(input, paragraphs); // split_with_positions(tempInput, "###PARA###");
-    std::vector<Paragraph> tempOutput2;
-    for (int i=0; i<(int)tempOutput.size(); i++) {
-        if ((int)(tempOutput[i].GetPosition().high-tempOutput[i].GetPosition().low) < minParagraphLen) {
-            tempOutput2.push_back(tempOutput[i]);   // The number of entities in a single sentence is too small, so it is discarded.
-        }
-        else {
-            outputs.push_back(tempOutput[i]);
+    ws.Fit(ws.mParagraphIds, paragraphs.size());
+    ws.Fit(ws.mPositions, paragraphs.size());
+    int kDim = 0;
+    // The number of entities in a single sentence is too small, so it is discarded.
+    // If there are too many sentences, they will be truncated
+    for (int i = 0; i < (int)paragraphs.size() && (maxParagraphs <= 0 || kDim < maxParagraphs); i++) {
+        if (paragraphs[i].second - paragraphs[i].first >= minParagraphLen) {
+            ws.mParagraphIds[kDim] = i;
+            ws.mPositions[kDim] = { paragraphs[i].first, paragraphs[i].second };
+            kDim++;
         }
     }
+    ws.mParagraphIds.resize(kDim);
+    ws.mPositions.resize(kDim);
 
      //Deduplication
     //RemoveDuplicates(tempOutput2, outputs);
 
-    // If there are too many sentences, they will be truncated
-    static const int maxParagraphsNum = 30;
-    if ((int)outputs.size() > maxParagraphsNum) {
-        outputs.resize(maxParagraphsNum);
+    return kDim > 0;
+}
+
+// Every mention goes to the paragraph the interval tree finds for it, then the mentions and the (entity, count)
+// of every paragraph are laid out as CSR arrays - the paragraphs the similarity policies see
+template <typename Weight>
+void BasicTextRanker<Weight>::AssignMentions(const std::vector<std::vector<std::pair<int, int>>>& entities, Workspace& ws) const
+{
+    int kDim = ws.mPositions.size();
+
+    // the first stage - duplicate / nested / overlapping mentions are normalized on a flat copy
+    size_t mentionsNum = 0;
+    for (const auto& mentions : entities) {
+        mentionsNum += mentions.size();
+    }
+    ws.Fit(ws.mSpanOffsets, entities.size() + 1);
+    ws.Fit(ws.mSpans, mentionsNum);
+    size_t spans = 0;
+    for (size_t e = 0; e < entities.size(); e++) {
+        ws.mSpanOffsets[e] = (uint32_t)spans;
+        std::copy(entities[e].begin(), entities[e].end(), ws.mSpans.begin() + spans);
+        spans += entities[e].size();
+    }
+    ws.mSpanOffsets[entities.size()] = (uint32_t)spans;
+    NormalizeMentions(ws.mSpans, ws.mSpanOffsets, mMentionPolicy);
+
+	// init the interval tree
+    ws.mTree.Clear();
+    if (ws.mTree.Reserve(kDim)) {
+        ws.mAllocations++;
+    }
+    for (int i = 0; i < kDim; i++) {
+        ws.mTree.Insert(i, ws.mPositions[i]);
+    }
+	// check the intervals
+    ws.Fit(ws.mAssignments, ws.mSpans.size());
+    size_t assigned = 0;
+    for (size_t e = 0; e < entities.size(); e++) {
+        for (uint32_t m = ws.mSpanOffsets[e]; m < ws.mSpanOffsets[e + 1]; m++) {
+            int paragraph = ws.mTree.OverlapSearch({ ws.mSpans[m].first, ws.mSpans[m].second });
+            if (paragraph < 0) {
+                ws.mUnassignedMentions++;
+            }
+            else {
+                ws.mAssignments[assigned++] = { paragraph, (EntityIndex)e };
+            }
+        }
+    }
+
+    // group by paragraph (stable, so the entities of a paragraph stay in increasing order), then count
+    ws.Fit(ws.mMentionOffsets, kDim + 1);
+    std::fill(ws.mMentionOffsets.begin(), ws.mMentionOffsets.end(), 0);
+    for (size_t m = 0; m < assigned; m++) {
+        ws.mMentionOffsets[ws.mAssignments[m].first + 1]++;
+    }
+    for (int i = 0; i < kDim; i++) {
+        ws.mMentionOffsets[i + 1] += ws.mMentionOffsets[i];
+    }
+    ws.Fit(ws.mCursor, kDim);
+    std::copy(ws.mMentionOffsets.begin(), ws.mMentionOffsets.begin() + kDim, ws.mCursor.begin());
+    ws.Fit(ws.mMentions, assigned);
+    for (size_t m = 0; m < assigned; m++) {
+        ws.mMentions[ws.mCursor[ws.mAssignments[m].first]++] = ws.mAssignments[m].second;
+    }
+
+    ws.Fit(ws.mCountOffsets, kDim + 1);
+    ws.Fit(ws.mCounts, assigned);
+    size_t counts = 0;
+    for (int i = 0; i < kDim; i++) {
+        ws.mCountOffsets[i] = (uint32_t)counts;
+        for (uint32_t m = ws.mMentionOffsets[i]; m < ws.mMentionOffsets[i + 1]; m++) {
+            if (counts > ws.mCountOffsets[i] && ws.mCounts[counts - 1].first == ws.mMentions[m]) {
+                ws.mCounts[counts - 1].second++;
+            }
+            else {
+                ws.mCounts[counts++] = { ws.mMentions[m], 1 };
+            }
+        }
+    }
+    ws.mCountOffsets[kDim] = (uint32_t)counts;
+    ws.Fit(ws.mViews, kDim);
+    for (int i = 0; i < kDim; i++) {
+        ws.mViews[i] = ParagraphView(MentionSpan(ws.mCounts.data() + ws.mCountOffsets[i], ws.mCountOffsets[i + 1] - ws.mCountOffsets[i]),
+            ws.mMentionOffsets[i + 1] - ws.mMentionOffsets[i]);
     }
-    return true;
 }
 
 
-bool TextRanker::BuildGraph(std::vector<Paragraph>& paragraphs, const std::vector<std::vector<Interval>>& entities)
+template <typename Weight>
+void BasicTextRanker<Weight>::BuildGraph(size_t entitiesNum, SimilarityKind similarity, Workspace& ws, WorkBudget* budget) const
+{
+    // pick one of the prebuilt instantiations, the pair loop itself has no branch on the policy
+    switch (similarity) {
+    case SimilarityKind::Jaccard:
+        return this->template BuildGraph<JaccardSimilarity>(entitiesNum, ws, budget);
+    case SimilarityKind::Cosine:
+        return this->template BuildGraph<CosineSimilarity>(entitiesNum, ws, budget);
+    case SimilarityKind::IdfOverlap:
+        return this->template BuildGraph<IdfOverlapSimilarity>(entitiesNum, ws, budget);
+    case SimilarityKind::LogOverlap:
+    default:
+        return this->template BuildGraph<LogOverlapSimilarity>(entitiesNum, ws, budget);
+    }
+}
+
+template <typename Weight>
+template <typename Similarity>
+void BasicTextRanker<Weight>::BuildGraph(size_t entitiesNum, Workspace& ws, WorkBudget* budget) const
 {
-    if (paragraphs.empty()) { return false; }
-    int kDim = paragraphs.size();
+    int kDim = ws.mViews.size();
 
-    // Calculate the adjacency matrix
-    mAdjacencyMatrix.clear();
-    mAdjacencyMatrix.resize(kDim, std::vector<double>(kDim, 0.0));
+    // Calculate the adjacency matrix (kDim x kDim, row major). Row i writes its diagonal, its pairs and their
+    // transposes, so every entry is written and the matrix is not cleared first
+    ws.Fit(ws.mAdjacency, (size_t)kDim * kDim);
 
-    InitCharsList(paragraphs, entities); // The words contained in each paragraph are made into a `set` in advance to speed up the calculation of GetSimilarity.
+    // the policies fill their buffers with assign/resize, so they only have to be big enough (entity ids < entitiesNum)
+    ws.Fit(ws.mSimilarity.paragraphNorm, kDim);
+    ws.Fit(ws.mSimilarity.entityWeight, entitiesNum);
+    ws.Fit(ws.mSimilarity.documentFrequency, entitiesNum);
+    Similarity::Prepare(ws.mSimilarity);
 
-    for(int i = 0; i < kDim - 1; i++)
+    // The weight of each node's outbound links is summed while the pairs are computed (in double, also when the
+    // graph is stored in float) - every node still adds its links in column order, and the matrix is not read again
+    ws.Fit(ws.mOutWeight, kDim);
+    std::fill(ws.mOutWeight.begin(), ws.mOutWeight.end(), 0.0);
+    if (budget != nullptr) {
+        budget->BeginStage();
+    }
+    for(int i = 0; i < kDim; i++)
     {
+        // An anytime call stops at a row boundary. The pairs of the rows that were not reached are not written - the
+        // budget is exhausted then, so no iteration reads the matrix, and the out-weights only have the pairs that were
+        if (budget != nullptr && i < kDim - 1) {
+            if (!budget->Allows(kDim - i - 1)) {
+                break;
+            }
+            budget->Spend(kDim - i - 1);
+        }
+        Weight* row = ws.mAdjacency.data() + (size_t)i * kDim;
+        row[i] = 0;  // no self links
         for(int j = i + 1; j < kDim; j++)
         {
-            double similarity = GetSimilarity(i, j);
+            Weight similarity = static_cast<Weight>(Similarity::Compute(ws.mSimilarity, i, j));
             // the similarity matrix is symmetrical, so transposes are filled in with the same similarity
-            mAdjacencyMatrix[i][j] = similarity;
-            mAdjacencyMatrix[j][i] = similarity;
+            row[j] = similarity;
+            ws.mAdjacency[(size_t)j * kDim + i] = similarity;
+            ws.mOutWeight[i] += similarity;
+            ws.mOutWeight[j] += similarity;
         }
     }
 
-    // Count the weight and number of outbound links of each node
-    mOutWeightSum.clear();
-    mOutWeightSum.resize(kDim, 0.0);
-
+    ws.Fit(ws.mOutWeightSum, kDim);
     for (int i=0; i<kDim; ++i) {
-        for (int j=0; j<kDim; ++j) {
-            if (i==j) { continue; }
-            mOutWeightSum[i] += mAdjacencyMatrix[i][j];
-        }
+        ws.mOutWeightSum[i] = static_cast<Weight>(ws.mOutWeight[i]);
     }
-
-    return true;
 }
 
-bool TextRanker::InitCharsList(std::vector<Paragraph>& paragraphs, const std::vector<std::vector<Interval>> entities)
+template <typename Weight>
+void BasicTextRanker<Weight>::BuildNeighbourLists(size_t entitiesNum, SimilarityKind similarity, NeighbourLists& graph, Workspace& ws) const
 {
-    int kDim = paragraphs.size();
-    if (paragraphs.empty()) {
-        return false;
+    switch (similarity) {
+    case SimilarityKind::Jaccard:
+        return this->template BuildNeighbourLists<JaccardSimilarity>(entitiesNum, graph, ws);
+    case SimilarityKind::Cosine:
+        return this->template BuildNeighbourLists<CosineSimilarity>(entitiesNum, graph, ws);
+    case SimilarityKind::IdfOverlap:
+        return this->template BuildNeighbourLists<IdfOverlapSimilarity>(entitiesNum, graph, ws);
+    case SimilarityKind::LogOverlap:
+    default:
+        return this->template BuildNeighbourLists<LogOverlapSimilarity>(entitiesNum, graph, ws);
     }
+}
 
-    //std::vector<Interval> ints;
+// The graph of BuildGraph as neighbour lists, for inputs too long for the matrix. All the policies give 0 to
+// paragraphs without a common entity, so only the pairs that share an entity are computed. The lists are the
+// ones NeighbourLists::Build makes from the matrix: the same weights and out-weights, neighbours in increasing order.
+template <typename Weight>
+template <typename Similarity>
+void BasicTextRanker<Weight>::BuildNeighbourLists(size_t entitiesNum, NeighbourLists& graph, Workspace& ws) const
+{
+    int kDim = ws.mViews.size();
+    ws.Fit(ws.mSimilarity.paragraphNorm, kDim);
+    ws.Fit(ws.mSimilarity.entityWeight, entitiesNum);
+    ws.Fit(ws.mSimilarity.documentFrequency, entitiesNum);
+    Similarity::Prepare(ws.mSimilarity);
 
-	// init the interval tree
-    std::shared_ptr<Node> root = nullptr;
-    for (size_t i = 0; i < (int)paragraphs.size(); i++)
-    {
-        //ints.push_back(paragraphs[i].GetPosition());
-        root = Node::insertTree(std::move(root), std::make_shared<Node>(i, paragraphs[i].GetPosition()));
+    // the links to later paragraphs of every paragraph, then every link in both rows
+    auto byEntity = ParagraphsByEntity(ws.mViews);
+    std::vector<size_t> upperOffsets(kDim + 1, 0), degree(kDim, 0);
+    std::vector<uint32_t> upperTargets, candidates;
+    std::vector<Weight> upperWeights;
+    std::vector<int> seen(kDim, -1);
+    for (int i = 0; i < kDim; i++) {
+        candidates.clear();
+        for (const auto& e : ws.mViews[i].GetMentionCounts()) {
+            const auto& others = byEntity[e.first];  // in increasing paragraph order
+            auto later = std::upper_bound(others.begin(), others.end(), std::make_pair((uint32_t)i, std::numeric_limits<double>::infinity()));
+            for (; later != others.end(); ++later) {
+                if (seen[later->first] != i) {
+                    seen[later->first] = i;
+                    candidates.push_back(later->first);
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (uint32_t j : candidates) {
+            Weight similarity = static_cast<Weight>(Similarity::Compute(ws.mSimilarity, i, j));
+            if (similarity > 0) {
+                upperTargets.push_back(j);
+                upperWeights.push_back(similarity);
+                degree[i]++;
+                degree[j]++;
+            }
+        }
+        upperOffsets[i + 1] = upperTargets.size();
     }
-    root->inorder();
-	// check the intervals
-    for (size_t i = 0; i < entities.size(); i++)
-    {
-        for (size_t j = 0; j < entities[i].size(); j++)
-        {
-            Node* res = root->overlapSearch(entities[i][j]);
-            if (res == nullptr)
-                std::cout << "\nNo overlaps ["<< entities[i][j].low<<" , "<< entities[i][j].high<<"]\n";
-            else
-                paragraphs[res->GetParagraphIndex()].SetEntities(i);
 
+    graph.offsets.assign(kDim + 1, 0);
+    for (int i = 0; i < kDim; i++) {
+        graph.offsets[i + 1] = graph.offsets[i] + degree[i];
+    }
+    graph.targets.resize(graph.offsets[kDim]);
+    graph.probabilities.resize(graph.offsets[kDim]);
+    std::vector<size_t> cursor(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (int i = 0; i < kDim; i++) {
+        // the links to earlier paragraphs of row i were written by their rows, the later ones follow
+        for (size_t k = upperOffsets[i]; k < upperOffsets[i + 1]; k++) {
+            uint32_t j = upperTargets[k];
+            graph.targets[cursor[i]] = j;
+            graph.probabilities[cursor[i]++] = upperWeights[k];
+            graph.targets[cursor[j]] = (uint32_t)i;
+            graph.probabilities[cursor[j]++] = upperWeights[k];
         }
     }
-    return true;
+
+    // weights to probabilities, the out-weight is summed in neighbour order and stored as Weight like BuildGraph does.
+    // Paragraphs with (almost) no out-weight have no neighbours, the lists are compacted
+    size_t kept = 0, begin = 0;
+    for (int i = 0; i < kDim; i++) {
+        size_t end = graph.offsets[i + 1];
+        double outWeight = 0.0;
+        for (size_t k = begin; k < end; k++) {
+            outWeight += graph.probabilities[k];
+        }
+        Weight out = static_cast<Weight>(outWeight);
+        graph.offsets[i] = kept;
+        if (out >= 1e-6) {
+            for (size_t k = begin; k < end; k++) {
+                graph.targets[kept] = graph.targets[k];
+                graph.probabilities[kept++] = graph.probabilities[k] / static_cast<double>(out);
+            }
+        }
+        begin = end;
+    }
+    graph.offsets[kDim] = kept;
+    graph.targets.resize(kept);
+    graph.probabilities.resize(kept);
 }
 
-float TextRanker::ParagraphScoreByPosition(int position, int totalParagraphs) const {
+template <typename Weight>
+float BasicTextRanker<Weight>::ParagraphScoreByPosition(int position, int totalParagraphs) const {
     float positionRatio;
     if (totalParagraphs > 1){
         positionRatio = position / (totalParagraphs - 1);
@@ -217,68 +1004,157 @@ float TextRanker::ParagraphScoreByPosition(int position, int totalParagraphs) co
 }
 
 
-double TextRanker::GetSimilarity(int a, int b)
+// teleport - optional restart weight of every paragraph (mean 1), empty means uniform
+template <typename Weight>
+bool BasicTextRanker<Weight>::CalcParagraphScores(Workspace& ws, const std::vector<double>& teleport, WorkBudget* budget) const
 {
-    // if a or b does not contains entities
-    if (mParagraphs[a].GetCharsNum() == 0 || mParagraphs[b].GetCharsNum() == 0) {
-        return 0.0;
+    if (ws.mOutWeightSum.empty()) {
+        return false;
     }
 
-    std::vector<size_t> commonChars;
-	std::set_intersection(
-		mParagraphs[a].GetEntities().begin(),
-		mParagraphs[a].GetEntities().end(),
-		mParagraphs[b].GetEntities().begin(),
-		mParagraphs[b].GetEntities().end(),
-		std::back_inserter(commonChars)
-	);
-    
-    double denominator = std::log(static_cast<double>(mParagraphs[a].GetCharsNum())) + std::log(static_cast<double>(mParagraphs[b].GetCharsNum()));
-    if (std::fabs(denominator) < 1e-6) {
-        return 0.0;
-    }
-    return 1.0 * commonChars.size() / denominator;
+    Iterate(ws.mAdjacency, ws.mOutWeightSum, teleport, true, ws.mScores, ws, budget);
+    return true;
 }
 
-bool TextRanker::CalcParagraphScores()
+// The power iteration of CalcParagraphScores on any symmetrical graph (kDim x kDim, row major) - positionPrior adds
+// the paragraph position bonus. The per-iteration buffers are the workspace's.
+template <typename Weight>
+void BasicTextRanker<Weight>::Iterate(const std::vector<Weight>& adjacency, const std::vector<Weight>& outWeightSum, const std::vector<double>& teleport, bool positionPrior, std::vector<Weight>& scores, Workspace& ws, WorkBudget* budget) const
 {
-    if (mAdjacencyMatrix.empty() || mAdjacencyMatrix[0].empty() || mOutWeightSum.empty()) {
-        return false;
-    }
-
-    int kDim = mParagraphs.size();
+    int kDim = outWeightSum.size();
 
     // Initially, the score of all nodes is 1.0
-    mScores.clear();
-    mScores.resize(kDim, 1.0);
+    ws.Fit(scores, kDim);
+    std::fill(scores.begin(), scores.end(), (Weight)1.0);
+    std::vector<Weight>& newScores = ws.mNewScores;  // current iteration score, swapped with scores after every iteration
+    ws.Fit(newScores, kDim);
+
+    // score[j] / outWeight[j] is the same for every i, so it is computed once per iteration.
+    // Nodes without outbound links get 0 and drop out of the sums.
+    std::vector<double>& contribution = ws.mContribution;
+    ws.Fit(contribution, kDim);
 
     // iterate
+    if (budget != nullptr) {
+        budget->BeginStage();
+    }
     int iterNum=0;
+    double maxDelta = std::numeric_limits<double>::infinity();
     for (; iterNum<mMaxIter; iterNum++) {
-        double maxDelta = 0.0;
-        std::vector<double> newScores(kDim, 0.0); // current iteration score
+        if (budget != nullptr) {
+            if (!budget->Allows((double)kDim * kDim)) {
+                break;
+            }
+            budget->Spend((double)kDim * kDim);
+        }
+        maxDelta = 0.0;
+
+        for (int j=0; j<kDim; j++) {
+            contribution[j] = outWeightSum[j] < 1e-6 ? 0.0 : scores[j] / static_cast<double>(outWeightSum[j]);
+        }
 
         for (int i=0; i<kDim; i++) {
+            // the matrix is symmetrical, so row i is read instead of column i (contiguous in memory)
+            const Weight* row = adjacency.data() + (size_t)i * kDim;
             double sum_weight = 0.0;
             for (int j=0; j<kDim; j++) {
-                if (i == j || mOutWeightSum[j] < 1e-6)
-                    continue;
-                double weight = mAdjacencyMatrix[j][i];
-                sum_weight += weight/mOutWeightSum[j] * mScores[j];
+                sum_weight += row[j] * contribution[j];  // row[i] is always 0, there are no self links
             }
-            double newScore = 1.0-m_d + m_d*sum_weight;
-            newScores[i] = newScore + this->ParagraphScoreByPosition(i, kDim);
+            double restart = teleport.empty() ? 1.0 : teleport[i];
+            double newScore = (1.0-m_d)*restart + m_d*sum_weight;
+            newScores[i] = static_cast<Weight>(positionPrior ? newScore + this->ParagraphScoreByPosition(i, kDim) : newScore);
 
-            double delta = fabs(newScore - mScores[i]);
+            // both with the position bonus, or the bonus alone keeps the delta above mTol
+            double delta = fabs(static_cast<double>(newScores[i]) - scores[i]);
             maxDelta = std::max(maxDelta, delta);
         }
 
-        mScores = newScores;
+        scores.swap(newScores);
         if (maxDelta < mTol) {
             break;
         }
     }
 
+    if (budget != nullptr) {
+        budget->iterations = iterNum;
+        budget->residual = maxDelta;
+        budget->converged = maxDelta < mTol;
+        // stopped before the first iteration - the weighted degree (scaled to mean 1) is the best estimate there is
+        if (iterNum == 0 && kDim > 0) {
+            double meanOutWeight = 0.0;
+            for (int i = 0; i < kDim; i++) {
+                meanOutWeight += outWeightSum[i];
+            }
+            meanOutWeight /= kDim;
+            for (int i = 0; i < kDim; i++) {
+                double degree = meanOutWeight > 0 ? outWeightSum[i] / meanOutWeight : 1.0;
+                double score = (1.0 - m_d) + m_d * degree;
+                scores[i] = static_cast<Weight>(positionPrior ? score + this->ParagraphScoreByPosition(i, kDim) : score);
+            }
+        }
+    }
+
     // std::cout << "iterNum: " << iterNum << "\n";
-    return true;
 }
+
+template <typename Weight>
+std::vector<std::pair<EntityIndex, double>> BasicTextRanker<Weight>::RankEntities(int topEntities, Workspace& ws) const
+{
+    // only the entities that are mentioned in a ranked paragraph are nodes
+    std::vector<int> node;
+    std::vector<EntityIndex> ids;
+    for (const ParagraphView& paragraph : ws.mViews) {
+        for (const auto& e : paragraph.GetMentionCounts()) {
+            if (e.first >= node.size()) {
+                node.resize(e.first + 1, -1);
+            }
+            if (node[e.first] < 0) {
+                node[e.first] = (int)ids.size();
+                ids.push_back(e.first);
+            }
+        }
+    }
+    int eDim = ids.size();
+
+    // every paragraph links each pair of its entities once
+    std::vector<Weight> adjacency((size_t)eDim * eDim, 0);
+    for (const ParagraphView& paragraph : ws.mViews) {
+        const auto& counts = paragraph.GetMentionCounts();
+        for (size_t a = 0; a < counts.size(); a++) {
+            for (size_t b = a + 1; b < counts.size(); b++) {
+                int i = node[counts[a].first], j = node[counts[b].first];
+                adjacency[(size_t)i * eDim + j] += 1;
+                adjacency[(size_t)j * eDim + i] += 1;
+            }
+        }
+    }
+    std::vector<Weight> outWeightSum(eDim, 0);
+    for (int i = 0; i < eDim; i++) {
+        double outWeight = 0.0;
+        for (int j = 0; j < eDim; j++) {
+            outWeight += adjacency[(size_t)i * eDim + j];
+        }
+        outWeightSum[i] = static_cast<Weight>(outWeight);
+    }
+
+    std::vector<Weight> scores;
+    Iterate(adjacency, outWeightSum, std::vector<double>(), false, scores, ws);
+
+    std::vector<std::pair<int, double>> order(eDim);
+    for (int i = 0; i < eDim; i++) {
+        order[i] = { (int)ids[i], (double)scores[i] };
+    }
+    size_t selected = topEntities > 0 ? std::min(order.size(), (size_t)topEntities) : order.size();
+    std::partial_sort(order.begin(), order.begin() + selected, order.end(), PairComp);
+
+    std::vector<std::pair<EntityIndex, double>> ranking(selected);
+    for (size_t i = 0; i < selected; i++) {
+        ranking[i] = { (EntityIndex)order[i].first, order[i].second };
+    }
+    return ranking;
+}
+
+
+// The rankers exposed to python and used by main.cpp
+template class BasicTextRanker<double>;
+template class BasicTextRanker<float>;
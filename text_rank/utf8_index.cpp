@@ -0,0 +1,173 @@
+#include "utf8_index.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_INDEX_SSE2 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+static inline bool IsContinuation(unsigned char c)
+{
+	return (c & 0xC0) == 0x80;
+}
+
+static inline int PopCount16(unsigned int mask)
+{
+#if defined(_MSC_VER)
+	return (int)__popcnt(mask);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+// Number of code points that start in [data, data + 16) and whether all 16 bytes are ASCII
+static inline int LeadBytes16(const unsigned char* data, bool& ascii)
+{
+#ifdef UTF8_INDEX_SSE2
+	__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	// continuation bytes are 0x80-0xBF, as signed chars they are the only ones below -64
+	int continuation = _mm_movemask_epi8(_mm_cmplt_epi8(chunk, _mm_set1_epi8(-64)));
+	ascii = _mm_movemask_epi8(chunk) == 0;
+	return 16 - PopCount16((unsigned int)continuation);
+#else
+	int leads = 0;
+	unsigned char high = 0;
+	for (int i = 0; i < 16; i++) {
+		leads += !IsContinuation(data[i]);
+		high |= data[i];
+	}
+	ascii = (high & 0x80) == 0;
+	return leads;
+#endif
+}
+
+
+Utf8Index::Utf8Index(const std::string& text)
+	: mText(text), mCodePoints(0), mAscii(true)
+{
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(mText.data());
+	size_t size = mText.size();
+	mCheckpoints.reserve(size / kStride + 1);
+
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		bool ascii;
+		int leads = LeadBytes16(data + i, ascii);
+		mAscii = mAscii && ascii;
+		// a checkpoint falls in this chunk, find its exact byte (at most one per chunk, kStride > 16)
+		size_t next = mCheckpoints.size() * kStride;
+		if (mCodePoints + leads > next) {
+			size_t cp = mCodePoints;
+			for (size_t j = i; j < i + 16; j++) {
+				if (!IsContinuation(data[j])) {
+					if (cp == next) {
+						mCheckpoints.push_back(j);
+					}
+					cp++;
+				}
+			}
+		}
+		mCodePoints += leads;
+	}
+	for (; i < size; i++) {
+		if (data[i] & 0x80) {
+			mAscii = false;
+		}
+		if (!IsContinuation(data[i])) {
+			if (mCodePoints == mCheckpoints.size() * kStride) {
+				mCheckpoints.push_back(i);
+			}
+			mCodePoints++;
+		}
+	}
+}
+
+size_t Utf8Index::CountCodePoints(const char* text, size_t size)
+{
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(text);
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		bool ascii;
+		count += LeadBytes16(data + i, ascii);
+	}
+	for (; i < size; i++) {
+		count += !IsContinuation(data[i]);
+	}
+	return count;
+}
+
+size_t Utf8Index::ByteOffset(size_t cp) const
+{
+	if (cp >= mCodePoints) {
+		return mText.size();
+	}
+	if (mAscii) {
+		return cp;
+	}
+
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(mText.data());
+	size_t byte = mCheckpoints[cp / kStride];
+	size_t remaining = cp % kStride;
+	while (remaining > 0) {
+		byte++;
+		if (!IsContinuation(data[byte])) {
+			remaining--;
+		}
+	}
+	return byte;
+}
+
+size_t Utf8Index::CodePointOffset(size_t byte) const
+{
+	if (byte >= mText.size()) {
+		return mCodePoints;
+	}
+	if (mAscii) {
+		return byte;
+	}
+
+	// last checkpoint at or before byte
+	size_t k = std::upper_bound(mCheckpoints.begin(), mCheckpoints.end(), byte) - mCheckpoints.begin() - 1;
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(mText.data());
+	size_t cp = k * kStride;
+	for (size_t b = mCheckpoints[k] + 1; b <= byte; b++) {
+		cp += !IsContinuation(data[b]);
+	}
+	return cp;
+}
+
+std::vector<std::pair<int, int>> Utf8Index::ToBytes(const std::vector<std::pair<int, int>>& spans) const
+{
+	std::vector<std::pair<int, int>> output(spans.size());
+	for (size_t i = 0; i < spans.size(); i++) {
+		output[i].first = (int)ByteOffset((size_t)std::max(spans[i].first, 0));
+		output[i].second = (int)ByteOffset((size_t)std::max(spans[i].second, 0));
+	}
+	return output;
+}
+
+std::vector<std::pair<int, int>> Utf8Index::ToCodePoints(const std::vector<std::pair<int, int>>& spans) const
+{
+	std::vector<std::pair<int, int>> output(spans.size());
+	for (size_t i = 0; i < spans.size(); i++) {
+		output[i].first = (int)CodePointOffset((size_t)std::max(spans[i].first, 0));
+		output[i].second = (int)CodePointOffset((size_t)std::max(spans[i].second, 0));
+	}
+	return output;
+}
+
+
+SpanUnits SpanUnitsFromName(const std::string& name)
+{
+	if (name == "codepoints")
+		return SpanUnits::CodePoints;
+	if (name == "bytes")
+		return SpanUnits::Bytes;
+	throw std::invalid_argument("Unknown span units: " + name);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Translates between code point offsets (python str indices) and byte offsets in the UTF-8 text
+// that pybind11 passes in. Built once per text: the bytes are scanned 16 at a time (SSE2 when available)
+// and the byte offset of every 64th code point is kept, so a conversion walks at most 63 code points.
+// Pure ASCII texts are detected while building and convert without any lookup.
+class Utf8Index
+{
+public:
+	Utf8Index() : mCodePoints(0), mAscii(true) { }
+	explicit Utf8Index(const std::string& text);
+
+	size_t CodePointsNum() const { return mCodePoints; }
+	size_t BytesNum() const { return mText.size(); }
+	bool IsAscii() const { return mAscii; }
+
+	// Byte offset of code point cp (cp is clamped to the end of the text)
+	size_t ByteOffset(size_t cp) const;
+	// Code point offset of byte (for a byte inside a multi-byte character - the character it belongs to)
+	size_t CodePointOffset(size_t byte) const;
+
+	// Batch conversions of spans (both ends are converted)
+	std::vector<std::pair<int, int>> ToBytes(const std::vector<std::pair<int, int>>& spans) const;
+	std::vector<std::pair<int, int>> ToCodePoints(const std::vector<std::pair<int, int>>& spans) const;
+
+	// Number of code points in [data, data + size) - the same 16 byte scan the index is built with
+	static size_t CountCodePoints(const char* data, size_t size);
+
+	static const size_t kStride = 64;  // code points between two checkpoints
+
+private:
+	std::string mText;  // a copy of the text, conversions scan it from the checkpoints
+	std::vector<size_t> mCheckpoints;  // byte offset of code point k * kStride
+	size_t mCodePoints;
+	bool mAscii;
+};
+
+
+// Units of the spans passed to the ranker
+enum class SpanUnits {
+	CodePoints,  // python str indices (the default everywhere)
+	Bytes        // offsets in the UTF-8 text
+};
+
+// "codepoints" or "bytes", throws std::invalid_argument for anything else
+SpanUnits SpanUnitsFromName(const std::string& name);